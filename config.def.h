@@ -13,6 +13,10 @@
  * See http://freedesktop.org/software/fontconfig/fontconfig-user.html
  */
 static const char          font[]             = "Sans Mono:size=9";
+static const char         *fallbackfonts[]    = {           /* for glyphs missing in font, tried in order */
+  "Noto Sans CJK JP:size=9",
+  "Symbola:size=9",
+};
 
 /* Colors.
  */
@@ -34,6 +38,8 @@ static const bool          showbar            = true;       /* false means no ba
 static const bool          topbar             = false;      /* false means bottom bar */
 static const int           user_bh            = 0;          /* 0 means that rawm will calculate bar height,
                                                                >= 1 means rawm will user_bh as bar height */
+static const unsigned int  barinterval        = 16;         /* minimum ms between bar redraws */
+static const bool          statusall          = false;      /* true means status on every monitor */
 
 /* Transparency for X11 compositor.
  */
@@ -46,6 +52,37 @@ static const unsigned int  systrayspacing     = 2;          /* systray spacing *
 static const bool          showsystray        = true;       /* false means no systray */
 #endif /* SYSTRAY */
 
+/* Status input FIFO, %s is replaced by the display name.  A relative
+ * path is taken in $XDG_RUNTIME_DIR, or /tmp if it is unset.
+ * The RAWM_STATUS environment variable overrides it, an empty path
+ * disables it.
+ */
+static const char          statusfifo[]       = "rawm%s.status";
+
+/* Built-in status modules, each writing a status block every interval
+ * milliseconds (0 runs it once).  Timers expiring together share a
+ * wakeup, so related intervals are cheaper.  Modules are battery, cpu,
+ * date, load, mem and net, none runs by default.
+ */
+static const Module        modules[]          = {
+/* Block        Module          Interval  Argument */
+/* { "cpu",     "cpu",          2000,     "cpu"         }, */
+/* { "mem",     "mem",          2000,     "mem"         }, */
+/* { "load",    "load",         10000,    "load"        }, */
+/* { "net",     "net",          2000,     "wlan0"       }, */
+/* { "bat",     "battery",      30000,    "BAT0"        }, */
+/* { "date",    "date",         60000,    "%a %H:%M"    }, */
+ { NULL },
+};
+
+/* IPC socket, %s is replaced by the display name.  A relative path is
+ * taken in $XDG_RUNTIME_DIR, or /tmp if it is unset.
+ * The RAWM_SOCKET environment variable overrides it.
+ */
+#ifdef IPC
+static const char          ipcsocket[]        = "rawm%s.sock";
+#endif /* IPC */
+
 /*********************************************************************
  * Layouts.
  */
@@ -163,6 +200,28 @@ static const char *mixer_inc_cmd[]  = { "amixer", "sset", "Master", "1+",     NU
 static const char *backlight_inc_cmd[] = { "xbacklight", "-inc", "10", NULL };
 static const char *backlight_dec_cmd[] = { "xbacklight", "-dec", "10", NULL };
 
+/* Commands kept running hidden in a warm pool, so that spawning them
+ * shows a window at once.  The command must create the window itself,
+ * it is recognized by its _NET_WM_PID.  Every hidden instance keeps a
+ * process running, so none are kept by default. */
+static const Pool pools[] = {
+/* Command      Size */
+/* { term_cmd,  1    }, */
+ { NULL },
+};
+
+/* Scratchpads, floating windows toggled on the current tags.  Their
+ * command is started on first use and must create the window itself,
+ * like those of the pools. */
+static const char *scratchterm_cmd[] = { "st", NULL };
+static const char *scratchcalc_cmd[] = { "st", "-e", "bc", "-lq", NULL };
+
+static const Scratchpad scratchpads[] = {
+/* Name         Command */
+ { "term",      scratchterm_cmd },
+ { "calc",      scratchcalc_cmd },
+};
+
 /*********************************************************************
  * Key definitions.
  */
@@ -179,6 +238,8 @@ static Key keys[] = {
  { MODKEY,                      XK_p,                     spawn,          {.v = pass_cmd}         },
 
  { MODKEY|ShiftMask,            XK_Return,                spawn,          {.v = term_cmd}         },
+ { MODKEY,                      XK_grave,                 togglescratch,  {.v = &scratchpads[0]}  },
+ { MODKEY,                      XK_apostrophe,            togglescratch,  {.v = &scratchpads[1]}  },
 
  { MODKEY,                      XK_b,                     togglebar,      {0}                     },
 
@@ -15,6 +15,17 @@ PWKL          = -DPWKL
 # optional windows title support
 WINTITLE      = -DWINTITLE
 
+# optional UNIX socket for commands and state queries
+IPC           = -DIPC
+
+# optional helper process starting the children
+LAUNCHER      = -DLAUNCHER
+
+# optional text shaping of titles and status, needs harfbuzz
+#HARFBUZZ     = -DHARFBUZZ
+#HARFBUZZINC  = -I/usr/include/harfbuzz
+#HARFBUZZLIBS = -lharfbuzz
+
 # paths
 PREFIX        = /usr/local
 MANPREFIX     = ${PREFIX}/share/man
@@ -36,12 +47,15 @@ FT2INC        = /usr/include/freetype2
 FT2LIB        = -lfontconfig -lXft
 
 # includes and libs
-INCS          = -I${X11INC} -I${FT2INC}
-LIBS          = -L${X11LIB} -lX11 ${FT2LIB} ${XINERAMALIBS}
+INCS          = -I${X11INC} -I${FT2INC} ${HARFBUZZINC}
+LIBS          = -L${X11LIB} -lX11 ${FT2LIB} ${XINERAMALIBS} ${HARFBUZZLIBS} \
+                -lpthread
 
 # flags
-CPPFLAGS      = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L \
+CPPFLAGS      = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_GNU_SOURCE \
+                -D_POSIX_C_SOURCE=200809L \
                 -DVERSION=\"${VERSION}\" \
-                ${XINERAMA} ${SYSTRAY} ${PWKL} ${WINTITLE}
+                ${XINERAMA} ${SYSTRAY} ${PWKL} ${WINTITLE} ${IPC} \
+                ${LAUNCHER} ${HARFBUZZ}
 CFLAGS        = -pedantic -Wall -Wextra -Wformat ${INCS} ${CPPFLAGS}
 LDFLAGS       = ${LIBS}
@@ -24,14 +24,20 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <locale.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <X11/cursorfont.h>
@@ -41,12 +47,32 @@
 #include <X11/Xproto.h>
 #include <X11/Xutil.h>
 #include <X11/Xft/Xft.h>
+#include <pthread.h>
 
 /* Per-window keyboard layout support. */
 #ifdef PWKL
 # include <X11/XKBlib.h>
 #endif /* PWKL */
 
+/* UNIX domain socket for commands and state queries. */
+#ifdef IPC
+# include <stdint.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+#endif /* IPC */
+
+/* Helper process starting the children of rawm. */
+#ifdef LAUNCHER
+# include <stdint.h>
+# include <sys/socket.h>
+#endif /* LAUNCHER */
+
+/* Text shaping of the bar text. */
+#ifdef HARFBUZZ
+# include <hb.h>
+# include <hb-ft.h>
+#endif /* HARFBUZZ */
+
 /* Xinerama support for multiple monitors. */
 #ifdef XINERAMA
 # include <X11/extensions/Xinerama.h>
@@ -89,6 +115,9 @@
  */
 #define ISVISIBLE(C)  ((C->tags & C->mon->tagset[C->mon->seltags]))
 
+/** Whether the bar of monitor M shows the status. */
+#define SHOWSTATUS(M) (statusall  ||  (M) == selmon)
+
 /**
  * @brief Calculate the number of elements in an array.
  * @param X The array.
@@ -114,6 +143,58 @@
 /** Maximum number of colors used for drawing. */
 #define MAXCOLORS  8
 
+/** Size of a color name given in the config file, like "#rrggbb" or an
+ * X color name. */
+#define MAXCOLORNAME 32
+
+/** Maximum number of fonts, including the fallback fonts. */
+#define MAXFONTS   8
+
+/** Number of codepoints whose font is cached, a power of two. */
+#define GLYPHCACHE 4096
+
+#ifdef HARFBUZZ
+/** Number of shaped runs of text cached, a power of two. */
+#define SHAPECACHE 256
+#endif /* HARFBUZZ */
+
+/** Maximum number of words of a config line, including the keyword. */
+#define CFGMAXARGS 64
+
+#ifdef IPC
+/** Maximum number of arguments of an IPC request, including the command. */
+# define IPCMAXARGS 64
+
+/** Maximum payload size of an IPC request. */
+# define IPCMAXMSG  65536
+
+/** Maximum number of queued bytes per subscriber, events are dropped beyond. */
+# define IPCMAXQUEUE 65536
+#endif /* IPC */
+
+#ifdef LAUNCHER
+/** Maximum size of a launch request, arguments and environment. */
+# define LAUNCHERMAXMSG 65536
+#endif /* LAUNCHER */
+
+/** Maximum length of a line read from the status FIFO. */
+#define STATUSMAXLINE 65536
+
+/** Maximum number of commands launched whose window is awaited. */
+#define MAXPENDING 16
+
+/** Delay in ms before a pool is refilled after losing a client. */
+#define POOLDELAY 1000
+
+/** Number of request ranges whose errors can be ignored at a time. */
+#define MAXIGNORED 32
+
+/** Timers expiring within this many ms of each other run together. */
+#define TIMERSLACK 50
+
+/** Maximum number of file descriptors watched by the main loop. */
+#define MAXWATCHES 64
+
 /** Mouse mask for grabbing pointer motion and button events */
 #define MOUSEMASK  (BUTTONMASK|PointerMotionMask)
 
@@ -198,6 +279,8 @@ enum {
   NetWMName,                /**< _NET_WM_NAME atom. */
   NetWMState,               /**< _NET_WM_STATE atom. */
   NetWMFullscreen,          /**< _NET_WM_STATE_FULLSCREEN atom. */
+  NetWMWindowOpacity,       /**< _NET_WM_WINDOW_OPACITY atom. */
+  NetWMPid,                 /**< _NET_WM_PID atom. */
   NetActiveWindow,          /**< _NET_ACTIVE_WINDOW atom. */
   NetClientList,            /**< _NET_CLIENT_LIST atom. */
   NetWMWindowType,          /**< _NET_WM_WINDOW_TYPE atom. */
@@ -237,6 +320,31 @@ enum {
   ClkLast        /**< Sentinel value for the last click area. */
 };
 
+/** Argument types of commands named in IPC requests and the config file. */
+enum {
+  ArgNone,    /**< No argument. */
+  ArgInt,     /**< Integer, optional (.i). */
+  ArgFloat,   /**< Float (.f). */
+  ArgTag,     /**< Tag number or "all", optional (.ui tag mask). */
+  ArgLayout,  /**< Layout index or symbol, optional (.v). */
+  ArgCmd,     /**< Command line to execute (.v). */
+  ArgScratch, /**< Scratchpad index or name (.v). */
+  ArgMouse    /**< No argument, needs a button press (bindings only). */
+};
+
+#ifdef IPC
+/** Events IPC clients can subscribe to. */
+enum {
+  EvFocus,  /**< Focused window or monitor changed. */
+  EvTag,    /**< Viewed tags of a monitor changed. */
+  EvLayout, /**< Layout of a monitor changed. */
+  EvMap,    /**< Window became managed. */
+  EvUnmap,  /**< Window became unmanaged. */
+  EvUrgent, /**< Urgency of a window changed. */
+  EvLast    /**< Sentinel value for the last event. */
+};
+#endif /* IPC */
+
 /** Argument union for key/button bindings. */
 typedef union {
  int i;           /**< Integer argument. */
@@ -270,13 +378,23 @@ struct Client {
   int bw, oldbw;        /**< Current and previous border width. */
   unsigned int tags;    /**< Tag mask indicating which tags the client is on. */
   bool isfixed, isfloating, iscentered, isurgent, neverfocus, oldstate, isfullscreen; /**< Various state flags. */
+  unsigned int protocols; /**< Supported WM_PROTOCOLS, bit mask of WM atom indexes. */
+  bool haswmh;          /**< Whether wmh holds the client's WM_HINTS. */
+  XWMHints wmh;         /**< Cached WM_HINTS. */
+  Atom winstate;        /**< Cached _NET_WM_STATE. */
+  Atom wintype;         /**< Cached _NET_WM_WINDOW_TYPE. */
   Client *next;         /**< Next client in the client list for the monitor. */
   Client *snext;        /**< Next client in the stack list for the monitor (focus history). */
   Monitor *mon;         /**< Pointer to the monitor the client is on. */
   Window win;           /**< X window ID. */
+  unsigned int pool;    /**< 1 + index in pools while hidden in a warm pool, 0 otherwise. */
+  unsigned int scratch; /**< 1 + index in scratchpads for a scratchpad, 0 otherwise. */
 #ifdef PWKL
   unsigned char kbdgrp; /**< Keyboard group for per-window layout. */
 #endif /* PWKL */
+#ifdef SYSTRAY
+  bool isdirty;         /**< Systray icon needs to be repositioned. */
+#endif /* SYSTRAY */
 };
 
 /**
@@ -287,13 +405,18 @@ struct Client {
 typedef struct {
   int x, y, w, h;    /**< Current drawing area geometry. */
   XftColor colors[MAXCOLORS][ColLast]; /**< Array of color schemes (NUMCOLORS from config.h). */
-  Drawable drawable; /**< Pixmap for double buffering. */
+  Drawable drawable; /**< Pixmap drawn to, the barpix of a monitor. */
   GC gc;             /**< Graphics context. */
   struct {
     int ascent;     /**< Font ascent. */
     int descent;    /**< Font descent. */
     int height;     /**< Font height (ascent + descent). */
     XftFont *xfont; /**< Xft font. */
+    XftFont *xfonts[MAXFONTS]; /**< Xft font followed by the fallback fonts. */
+    unsigned int nxfonts;      /**< Number of loaded fonts. */
+#ifdef HARFBUZZ
+    hb_font_t *hbfonts[MAXFONTS]; /**< HarfBuzz fonts of xfonts. */
+#endif /* HARFBUZZ */
   } font; /**< Font information. */
 } DC;
 
@@ -330,6 +453,37 @@ typedef struct {
 /* Forware declaration for Pertag structure. */
 typedef struct Pertag Pertag;
 
+/**
+ * @brief Bar-visible state of a monitor.
+ *
+ * Snapshot of everything renderbar() derives from the client list, used
+ * to skip redrawing bars whose content did not change.
+ */
+typedef struct {
+  Client       *sel;          /**< Selected client. */
+  unsigned int  seltags;      /**< Tags of the selected client. */
+  unsigned int  occ;          /**< Occupied tags. */
+  unsigned int  urg;          /**< Tags with urgent clients. */
+  unsigned int  tagset;       /**< Currently viewed tags. */
+  bool          isselmon;     /**< Whether the monitor is selected. */
+  bool          selfixed;     /**< Whether the selected client is fixed. */
+  bool          selfloating;  /**< Whether the selected client floats. */
+  int           w;            /**< Width of the bar, without the systray. */
+  char          ltsymbol[16]; /**< Layout symbol. */
+} BarState;
+
+/**
+ * @brief Part of a bar, as drawn by renderbar().
+ *
+ * A segment ends where the next one starts, buttonpress() looks up
+ * the clicked one by a binary search.
+ */
+typedef struct {
+  int           x;      /**< Left edge. */
+  unsigned int  click;  /**< Click area, one of the Clk* values. */
+  unsigned int  arg;    /**< Tag mask of a tag, index of a status block. */
+} Segment;
+
 /**
  * @brief Monitor structure to manage screens.
  */
@@ -353,6 +507,17 @@ struct Monitor {
   Window barwin;          /**< Window ID of the status bar for this monitor. */
   const Layout *lt[2];    /**< Array holding current and previous layout (per tag). */
   Pertag *pertag;         /**< Pointer to the per-tag configuration for this monitor. */
+  BarState bar;           /**< Bar state at the time of the last renderbar(). */
+  Pixmap barpix;          /**< Bar content, shown again on Expose. */
+  int barpixw;            /**< Width of barpix. */
+  int statusx;            /**< Status position in the bar, -1 if clipped or not shown. */
+  Segment *segs;          /**< Parts of the bar, from left to right. */
+  unsigned int nsegs;     /**< Number of segments. */
+  bool bardirty;          /**< Whether renderbar() is due at the next frame. */
+#ifdef IPC
+  unsigned int ipctagset; /**< Viewed tags last published to subscribers. */
+  const Layout *ipclt;    /**< Layout last published to subscribers. */
+#endif /* IPC */
 };
 
 /**
@@ -371,6 +536,84 @@ typedef struct {
   int monitor;          /**< Monitor to spawn on (-1 for current). */
 } Rule;
 
+/**
+ * @brief Warm pool of hidden, already running instances of a command.
+ *
+ * Used in the 'pools' array from `config.h'.
+ */
+typedef struct {
+  const char **cmd;     /**< Command, matched against the spawn arguments. */
+  unsigned int size;    /**< Number of instances kept ready. */
+} Pool;
+
+/**
+ * @brief Named scratchpad, a floating window shown and hidden at will.
+ *
+ * Used in the 'scratchpads' array from `config.h'.
+ */
+typedef struct {
+  const char  *name;    /**< Name used in the config file and IPC. */
+  const char **cmd;     /**< Command started on first use. */
+} Scratchpad;
+
+/**
+ * @brief Named part of the status text, updated on its own.
+ *
+ * The "root" block holds WM_NAME of the root window, the others are
+ * written to the status FIFO.  Blocks are shown in order of creation.
+ */
+typedef struct {
+  char         *name;   /**< Block name. */
+  char         *text;   /**< Text, may contain color codes. */
+  struct Span  *spans;  /**< Text split at the color codes. */
+  unsigned int  nspans; /**< Number of spans. */
+  int           w;      /**< Width on the bar, 0 for an empty text. */
+  bool          dirty;  /**< Text changed since it was last drawn. */
+} Block;
+
+/**
+ * @brief Run of status text drawn in one color.
+ *
+ * Built by parsestatus() when the text of a block changes, so that
+ * redrawing a block neither parses nor measures its text.
+ */
+typedef struct Span {
+  XftColor *col;        /**< Color scheme, one of dc.colors. */
+  size_t    off;        /**< Offset of the run in the block text. */
+  int       len;        /**< Length of the run in bytes. */
+  int       w;          /**< Width of the run. */
+} Span;
+
+#ifdef HARFBUZZ
+/**
+ * @brief Glyphs of a run of text shaped with one font.
+ *
+ * Kept by shaperun() until another run takes its cache entry, so
+ * that unchanged titles and status text are not shaped again.
+ */
+typedef struct {
+  char          *text;     /**< Shaped text, NULL for an unused entry. */
+  int            len;      /**< Length of the text in bytes. */
+  XftFont       *font;     /**< Font the text was shaped with. */
+  unsigned int   nglyphs;  /**< Number of glyphs, in visual order. */
+  XftGlyphSpec  *specs;    /**< Glyphs, positioned relative to the run. */
+  unsigned int  *clusters; /**< Byte offset of the cluster of each glyph. */
+  int           *pen;      /**< Pen position before each glyph, and after the last. */
+} Shaped;
+#endif /* HARFBUZZ */
+
+/**
+ * @brief Built-in status collector, run by a timer of the main loop.
+ *
+ * Used in the 'modules' array from `config.h'.
+ */
+typedef struct {
+  const char   *block;    /**< Status block written, NULL for none. */
+  const char   *name;     /**< Built-in module, see 'modfuncs'. */
+  unsigned int  interval; /**< Update interval in ms. */
+  const char   *arg;      /**< Argument for the module. */
+} Module;
+
 #ifdef SYSTRAY
 /**
  * @brief Systray structure.
@@ -381,13 +624,128 @@ typedef struct Systray Systray;
 struct Systray {
   Window win;    /**< Systray window ID. */
   Client *icons; /**< List of systray icons (treated as clients). */
+  Monitor *mon;  /**< Monitor the systray is placed on. */
+  int x, y;      /**< Current systray window position. */
+  unsigned int w; /**< Current systray window width. */
 };
 #endif /* SYSTRAY */
 
+#ifdef IPC
+/**
+ * @brief Growable byte buffer.
+ */
+typedef struct {
+  char   *data; /**< Buffer contents, not NUL-terminated. */
+  size_t  len;  /**< Number of bytes used. */
+  size_t  size; /**< Number of bytes allocated. */
+} Buffer;
+
+/**
+ * @brief Connection to the IPC socket.
+ */
+typedef struct IpcClient IpcClient;
+struct IpcClient {
+  int          fd;      /**< Connection socket. */
+  Buffer       in;      /**< Received, not yet processed data. */
+  Buffer       out;     /**< Replies and events not yet sent. */
+  unsigned int events;  /**< Subscribed events (1 << Ev...), 0 if none. */
+  unsigned int dropped; /**< Events dropped since the queue was full. */
+  IpcClient   *next;    /**< Next connection. */
+};
+#endif /* IPC */
+
+/**
+ * @brief Command which can be named in IPC requests and the config file.
+ */
+typedef struct {
+  const char *name;             /**< Name of the command. */
+  void (*func)(const Arg *arg); /**< Function to execute. */
+  int argtype;                  /**< Argument type (enum Arg...). */
+} Command;
+
+/**
+ * @brief Active rules and bindings.
+ *
+ * Copies of the tables from config.h, replaced by the ones from the
+ * runtime configuration file.
+ */
+typedef struct {
+  Rule         *rules;    /**< Rules. */
+  unsigned int  nrules;   /**< Number of rules. */
+  Key          *keys;     /**< Key bindings. */
+  unsigned int  nkeys;    /**< Number of key bindings. */
+  Button       *buttons;  /**< Button bindings. */
+  unsigned int  nbuttons; /**< Number of button bindings. */
+  void        **mem;      /**< Strings and argument vectors used by the tables. */
+  unsigned int  nmem;     /**< Number of entries in mem. */
+} Config;
+
+/**
+ * @brief External prompt whose answer is awaited by the main loop.
+ *
+ * The monitor and the tags are those selected when the prompt was
+ * opened, the selection may change while the user is typing.
+ */
+typedef struct {
+  int          fd;                  /**< Read end of the pipe, -1 if no prompt is open. */
+  char         buf[MAX_TAGNAMELEN]; /**< Answer read so far. */
+  size_t       len;                 /**< Length of the answer. */
+  int          mon;                 /**< Number of the monitor being renamed. */
+  unsigned int tags;                /**< Tag mask being renamed. */
+} Prompt;
+
+/**
+ * @brief Client state saved across a restart.
+ *
+ * Fullscreen clients are saved with their state before fullscreen,
+ * which is applied again from _NET_WM_STATE.
+ */
+typedef struct {
+  Window        win;        /**< X window ID. */
+  int           mon;        /**< Monitor number. */
+  unsigned int  tags;       /**< Tag mask. */
+  bool          isfloating; /**< Floating state. */
+  bool          issel;      /**< Whether it is the selected client of its monitor. */
+  int           x, y, w, h; /**< Geometry. */
+  int           oldbw;      /**< Border width before being managed. */
+  unsigned char kbdgrp;     /**< Keyboard group for per-window layout. */
+  unsigned int  pool;       /**< Warm pool of the client, see Client. */
+  unsigned int  scratch;    /**< Scratchpad of the client, see Client. */
+} SavedClient;
+
+/**
+ * @brief Timer run by the main loop.
+ */
+typedef struct Timer Timer;
+struct Timer {
+  long long     when;           /**< Expiry time (clockms()). */
+  unsigned int  interval;       /**< Repeat interval in ms, 0 for one-shot. */
+  void        (*func)(void *);  /**< Function to execute on expiry. */
+  void         *arg;            /**< Argument for the function. */
+  Timer        *next;           /**< Next timer, ordered by expiry time. */
+};
+
+/**
+ * @brief File descriptor callback of the main loop.
+ *
+ * The descriptor itself is kept in the pollfd array passed to poll(2).
+ */
+typedef struct {
+  void (*func)(int fd, short revents, void *arg); /**< Function to execute when ready. */
+  void  *arg;                                     /**< Argument for the function. */
+} Watch;
+
 /*********************************************************************
  * Function declarations.
  */
 
+static void           addsegment(Monitor *m, int x, unsigned int click,
+                                 unsigned int arg);
+static Timer         *addtimer(unsigned int ms, unsigned int interval,
+                                void (*func)(void *), void *arg);
+static bool           addwatch(int fd, short events,
+                               void (*func)(int, short, void *),
+                               void *arg);
 static void           applyrules(Client *c);
 static bool           applysizehints(Client *c, int *x, int *y,
                                      int *w, int *h, bool interact);
@@ -395,38 +753,57 @@ static void           arrange(Monitor *m);
 static void           arrangemon(Monitor *m);
 static void           attach(Client *c);
 static void           attachstack(Client *c);
+#ifdef IPC
+static void           bufappend(Buffer *b, const void *data, size_t len);
+static void           bufprintf(Buffer *b, const char *fmt, ...);
+#endif /* IPC */
 static void           bstack(Monitor *m);
 static void           bstackhoriz(Monitor *m);
 static void           buttonpress(XEvent *e);
 static void           checkotherwm(void);
+static long long      clockms(void);
 static void           cleanup(void);
 static void           cleanupmon(Monitor *mon);
 static void           clearurgent(Client *c);
 static void           clientmessage(XEvent *e);
+static char          *configstr(Config *c, const char *str);
 static void           configure(Client *c);
 static void           configurenotify(XEvent *e);
 static void           configurerequest(XEvent *e);
 static Monitor       *createmon(int idx);
+static void           deltimer(Timer *t);
+static void           delwatch(int fd);
 static void           destroynotify(XEvent *e);
 static void           detach(Client *c);
 static void           detachstack(Client *c);
 static void           die(const char *errstr, ...);
 static Monitor       *dirtomon(int dir);
+static bool           displaypath(char *path, size_t size,
+                                  const char *fmt, const char *var);
 static void           drawbar(Monitor *m);
 static void           drawbars(void);
-static void           drawcoloredtext(char *text);
+static void           drawblock(Block *b);
 static void           drawsquare(bool filled, bool empty,
                                  XftColor col[ColLast]);
+static void           drawstatus(int x, int w);
+static void           drawstring(const char *text, int len, int tw,
+                                 int x, int w, XftColor col[ColLast]);
 static void           drawtext(const char *text, XftColor col[ColLast],
                                bool pad);
 static void           enternotify(XEvent *e);
 static void           expose(XEvent *e);
+static int            flushbars(void);
+static void           flushstatus(void);
 static void           focus(Client *c);
 static void           focusin(XEvent *e);
 static void           focusmon(const Arg *arg);
 static void           focusnstack(const Arg *arg);
 static void           focusstack(const Arg *arg);
+static void          *fontinit(void *arg);
+static int            fontrun(const char *text, int len, XftFont **f);
+static void           freeconfig(Config *c);
 static void           gaplessgrid(Monitor *m);
+static void           getbarstate(Monitor *m, BarState *bs);
 
 #ifdef SYSTRAY
 static Atom           getatomprop(Client *c, Atom prop);
@@ -434,6 +811,7 @@ static unsigned int   getsystraywidth();
 static void           removesystrayicon(Client *i);
 static void           resizebarwin(Monitor *m);
 static void           resizerequest(XEvent *e);
+static void           setsystraydirty(Client *i);
 static void           updatesystray(void);
 static void           updatesystrayicongeom(Client *i, int w, int h);
 static void           updatesystrayiconstate(Client *i, XPropertyEvent *ev);
@@ -442,24 +820,77 @@ static Client        *wintosystrayicon(Window w);
 
 static XftColor       getcolor(const char *colstr);
 static bool           getrootptr(int *x, int *y);
+static SavedClient   *getsaved(Window w);
+static pid_t          getwinpid(Window w);
 static long           getstate(Window w);
+static char          *gettextdup(Window w, Atom atom);
 static bool           gettextprop(Window w, Atom atom, char *text,
                                   unsigned int size);
+static unsigned int   glyphfont(FcChar32 cp);
+static void          *growarray(void *p, unsigned int n, size_t size);
 static void           grabbuttons(Client *c, bool focused);
 static void           grabkeys(void);
+static bool           hasprotocol(Client *c, Atom proto);
+static unsigned long  ignorebegin(void);
+static void           ignoreend(unsigned long first);
 static void           incnmaster(const Arg *arg);
 static void           initfont(const char *fontstr);
+static void           initspawn(void);
+
+#ifdef IPC
+static void           ipcaccept(int fd, short revents, void *arg);
+static bool           ipcallowed(int fd);
+static void           ipccleanup(void);
+static void           ipcdisconnect(IpcClient *ic);
+static void           ipcdump(Buffer *b);
+static void           ipcevent(int ev, Monitor *m, const char *fmt, ...);
+static void           ipcinput(int fd, short revents, void *arg);
+static void           ipcpublish(void);
+static void           ipcrequest(IpcClient *ic, char *msg, size_t len);
+static int            ipcsend(int argc, char *argv[]);
+static void           ipcsetup(void);
+static bool           ipcwrite(IpcClient *ic);
+#endif /* IPC */
+
 static void           keypress(XEvent *e);
 static void           killclient(const Arg *arg);
+static pid_t          launch(char *const argv[], int outfd);
+#ifdef LAUNCHER
+static void           launcherloop(int fd);
+static bool           launcherrequest(char *const argv[], int outfd);
+static void           launcherstart(void);
+#endif /* LAUNCHER */
+static int            loadconfig(Config *c);
+static void           loadstate(void);
 static void           manage(Window w, XWindowAttributes *wa);
 static void           mappingnotify(XEvent *e);
 static void           maprequest(XEvent *e);
+static void           modbattery(char *buf, size_t size, const char *arg);
+static void           modcpu(char *buf, size_t size, const char *arg);
+static void           moddate(char *buf, size_t size, const char *arg);
+static void           modload(char *buf, size_t size, const char *arg);
+static void           modmem(char *buf, size_t size, const char *arg);
+static void           modnet(char *buf, size_t size, const char *arg);
+static void           modrun(void *arg);
+static void           modsetup(void);
 static void           monocle(Monitor *m);
 static void           motionnotify(XEvent *e);
 static void           movemouse(const Arg *arg);
 static void           nametag(const Arg *arg);
 static Client        *nexttiled(Client *c);
+static bool           parsearg(const Command *cmd, char *argv[], Arg *arg);
+static int            parsestatus(Block *b);
+static bool           parsemods(const char *str, unsigned int *mods);
+static bool           pendingadd(const char **cmd, unsigned int pool,
+                                 unsigned int scratch);
+static bool           pendingmatch(Client *c);
+static void           pendingreap(pid_t pid);
 static void           pop(Client *);
+static Client        *poolclient(unsigned int i);
+static void           poolfill(void);
+static int            poolfind(const char *const argv[]);
+static void           poolrefill(void *arg);
+static void           profilephase(const char *phase);
 static void           propertynotify(XEvent *e);
 static void           quit(const Arg *arg);
 static Monitor       *recttomon(int x, int y, int w, int h);
@@ -467,8 +898,18 @@ static void           resize(Client *c, int x, int y, int w, int h,
                              bool interact);
 static void           resizeclient(Client *c, int x, int y, int w, int h);
 static void           resizemouse(const Arg *arg);
+static ssize_t        readfile(const char *path, char *buf, size_t size);
+static void           readprompt(int fd, short revents, void *arg);
+static void           readsignals(int fd, short revents, void *arg);
+static void           readstatus(int fd, short revents, void *arg);
+static void           reload(const Arg *arg);
+static void           renderbar(Monitor *m);
 static void           restack(Monitor *m);
+static void           restoreclient(Client *c, SavedClient *s);
+static void           restoreorder(void);
 static void           run(void);
+static int            runtimers(void);
+static void           savestate(void);
 static void           scan(void);
 
 #ifdef SYSTRAY
@@ -479,24 +920,35 @@ static bool           sendevent(Client *c, Atom proto);
 #endif /* SYSTRAY */
 
 static void           sendmon(Client *c, Monitor *m);
+static void           setblock(const char *name, const char *text);
 static void           setclientstate(Client *c, long state);
 static void           setfocus(Client *c);
 static void           setfullscreen(Client *c, bool fullscreen);
 static void           setlayout(const Arg *arg);
 static void           setmfact(const Arg *arg);
 static void           setup(void);
+#ifdef IPC
+static void           setwatch(int fd, short events);
+#endif /* IPC */
+#ifdef HARFBUZZ
+static Shaped        *shaperun(const char *text, int len, XftFont *f);
+#endif /* HARFBUZZ */
 static void           showhide(Client *c);
-static void           sigchld(int sig);
-static void           sighup(int sig);
-static void           sigterm(int sig);
+static void           statuscleanup(void);
+static void           statussetup(void);
+static void           sighandler(int sig);
 static void           spawn(const Arg *arg);
+static pid_t          spawnchild(char *const argv[], int outfd);
+static void           summon(Client *c);
 static void           tag(const Arg *arg);
 static void           tagmon(const Arg *arg);
 static int            textnw(const char *text, unsigned int len);
+static int            tokenize(char *str, char *argv[], int max);
 static void           tile(Monitor *);
 static void           togglebar(const Arg *arg);
 static void           togglefloating(const Arg *arg);
 static void           togglefullscr(const Arg *arg);
+static void           togglescratch(const Arg *arg);
 static void           toggletag(const Arg *arg);
 static void           toggleview(const Arg *arg);
 static void           unfocus(Client *c, bool setfocus);
@@ -506,7 +958,9 @@ static bool           updategeom(void);
 static void           updatebarpos(Monitor *m);
 static void           updatebars(void);
 static void           updateclientlist(void);
+static void           updateltsymbol(Monitor *m);
 static void           updatenumlockmask(void);
+static void           updateprotocols(Client *c);
 static void           updatesizehints(Client *c);
 static void           updatestatus(void);
 static void           updatewindowtype(Client *c);
@@ -517,8 +971,10 @@ static Client        *wintoclient(Window w);
 static Monitor       *wintomon(Window w);
 static void           winview(const Arg* arg);
 static int            xerror(Display *dpy, XErrorEvent *ee);
-static int            xerrordummy(Display *dpy, XErrorEvent *ee);
 static int            xerrorstart(Display *dpy, XErrorEvent *ee);
+#ifdef PWKL
+static void           xkbstatenotify(XEvent *e);
+#endif /* PWKL */
 static void           zoom(const Arg *arg);
 
 /*********************************************************************
@@ -531,10 +987,25 @@ static unsigned long systrayorientation = _NET_SYSTEM_TRAY_ORIENTATION_HORZ;
 #endif /* SYSTRAY */
 
 static const char     broken[] = "broken";
-static char           stext[256];
+static Block         *blocks = NULL;            /* status text */
+static unsigned int   nblocks = 0;
+static int            statusw = 0;              /* sum of block widths */
+static Pixmap         statuspix = None;         /* status drawn once for all bars */
+static int            statuspixw = 0;
+static bool           statusdirty = false;      /* a block changed */
+static bool           statusfull = false;       /* needs a drawbar() */
+static long long      barframe = 0;             /* last flushbars() redraw */
+static unsigned long  barrequests = 0;          /* drawbar() calls */
+static unsigned long  barrenders = 0;           /* renderbar() calls */
+static unsigned long  barblits = 0;             /* copies to bar windows */
+static int            statusfd = -1, statuswfd = -1; /* status FIFO */
+static char           statuspath[PATH_MAX];
+static char           statusin[STATUSMAXLINE];  /* partial input line */
+static size_t         statuslen = 0;
+static bool           statusskip = false;       /* in a too long line */
 static int            screen;
 static int            sw, sh; /* X display screen geometry width, height */
-static int            bh, blw = 0; /* bar geometry */
+static int            bh; /* bar geometry */
 static int           (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int   numlockmask = 0;
 static void          (*handler[LASTEvent]) (XEvent *) = {
@@ -564,12 +1035,61 @@ static Atom           wmatom[WMLast], netatom[NetLast];
 #endif /* SYSTRAY */
 
 static bool           restart = false;
+static bool           profile = false;          /* startup timing report */
+static long long      profilestart, profilelast; /* in microseconds */
+static pthread_t      fontthread;               /* runs fontinit() */
+static bool           fontthreadrunning = false;
+static struct {
+  FcChar32      key;    /* codepoint + 1, 0 if unused */
+  unsigned char font;   /* index in dc.font.xfonts */
+}                     glyphs[GLYPHCACHE];       /* glyphfont() results */
+#ifdef HARFBUZZ
+static Shaped         shaped[SHAPECACHE];       /* shaperun() results */
+#endif /* HARFBUZZ */
 static bool           running = true;
+static bool           scanning = false;         /* scan() is managing */
+static SavedClient   *saved = NULL;             /* state of the previous */
+static unsigned int   nsaved = 0;               /* process, in client */
+static Window         *savedstack = NULL;       /* and in stack order */
+static unsigned int   nsavedstack = 0;
+#ifdef PWKL
+static int            xkbevent = -1; /* Xkb extension event base */
+static unsigned char  kbdgrp = 0;    /* current keyboard group */
+#endif /* PWKL */
 static Cursor         cursor[CurLast];
+static struct {
+  unsigned long first, last;
+}                     ignored[MAXIGNORED]; /* ring of ignored request ranges */
+static unsigned int   nignored = 0;
 static Display       *dpy;
 static DC             dc;
 static Monitor       *mons = NULL, *selmon = NULL;
 static Window         root;
+static int            sigpipe[2] = { -1, -1 }; /* signal self-pipe */
+static posix_spawnattr_t spawnattr;            /* attributes of children */
+#ifdef LAUNCHER
+static int            launcherfd = -1;          /* socket to the launcher */
+#endif /* LAUNCHER */
+static Timer         *timers = NULL;
+static struct pollfd  pfds[MAXWATCHES];        /* main loop descriptors */
+static Watch          watches[MAXWATCHES];     /* and their callbacks */
+static int            nwatches = 0;
+static Prompt         prompt = { .fd = -1 };
+#ifdef IPC
+static int            ipcfd = -1;                /* listening socket */
+static char           ipcpath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static IpcClient     *ipcclients = NULL;
+static int            ipcfocusmon = -1;         /* focus last published */
+static Window         ipcfocuswin = None;
+static const char    *ipcevents[EvLast] = {
+  [EvFocus]  = "focus",
+  [EvTag]    = "tag",
+  [EvLayout] = "layout",
+  [EvMap]    = "map",
+  [EvUnmap]  = "unmap",
+  [EvUrgent] = "urgent",
+};
+#endif /* IPC */
 
 /* Configuration, allows nested code to access above variables. */
 #include "config.h"
@@ -590,6 +1110,74 @@ struct NumTags {
   char limitexceeded[TAGS > 31 ? -1 : 1];
 };
 
+static const Command commands[] = {
+/* Name               Function        Argument */
+ { "focusmon",        focusmon,       ArgInt     },
+ { "focusnstack",     focusnstack,    ArgInt     },
+ { "focusstack",      focusstack,     ArgInt     },
+ { "incnmaster",      incnmaster,     ArgInt     },
+ { "killclient",      killclient,     ArgNone    },
+ { "movemouse",       movemouse,      ArgMouse   },
+ { "nametag",         nametag,        ArgNone    },
+ { "quit",            quit,           ArgInt     },
+ { "reload",          reload,         ArgNone    },
+ { "resizemouse",     resizemouse,    ArgMouse   },
+ { "setlayout",       setlayout,      ArgLayout  },
+ { "setmfact",        setmfact,       ArgFloat   },
+ { "spawn",           spawn,          ArgCmd     },
+ { "tag",             tag,            ArgTag     },
+ { "tagmon",          tagmon,         ArgInt     },
+ { "togglebar",       togglebar,      ArgNone    },
+ { "togglefloating",  togglefloating, ArgNone    },
+ { "togglefullscr",   togglefullscr,  ArgNone    },
+ { "togglescratch",   togglescratch,  ArgScratch },
+ { "toggletag",       toggletag,      ArgTag     },
+ { "toggleview",      toggleview,     ArgTag     },
+ { "view",            view,           ArgTag     },
+ { "winview",         winview,        ArgNone    },
+ { "zoom",            zoom,           ArgNone    },
+};
+
+/* Built-in status modules by name, for the 'modules' array. */
+static const struct {
+  const char  *name;
+  void       (*func)(char *buf, size_t size, const char *arg);
+} modfuncs[] = {
+/* Name         Function */
+ { "battery",   modbattery  },
+ { "cpu",       modcpu      },
+ { "date",      moddate     },
+ { "load",      modload     },
+ { "mem",       modmem      },
+ { "net",       modnet      },
+};
+
+/* Functions of the modules, resolved by modsetup(). */
+static void         (*modfunc[LENGTH(modules)])(char *buf, size_t size,
+                                                const char *arg);
+
+/* Click areas by name, for the config file. */
+static const char    *clicks[ClkLast] = {
+  [ClkTagBar]     = "tagbar",
+  [ClkLtSymbol]   = "ltsymbol",
+  [ClkStatusText] = "statustext",
+#ifdef WINTITLE
+  [ClkWinTitle]   = "wintitle",
+#endif /* WINTITLE */
+  [ClkClientWin]  = "clientwin",
+  [ClkRootWin]    = "rootwin",
+};
+
+static Config         cfg;
+static char           colornames[NUMCOLORS][ColLast][MAXCOLORNAME]; /* active colors */
+static struct {
+  pid_t        pid;
+  unsigned int pool;    /* as in Client */
+  unsigned int scratch; /* as in Client */
+}                     pending[MAXPENDING];      /* launched, not managed */
+static unsigned int   npending = 0;
+static Timer         *pooltimer = NULL;         /* delayed poolfill() */
+
 /*********************************************************************
  * Function implementations.
  */
@@ -613,6 +1201,64 @@ getprop(Window w, const char *prop)
   return (char *)val;
 }
 
+/* Appends a segment starting at x to the bar of m. */
+static void
+addsegment(Monitor *m, int x, unsigned int click, unsigned int arg)
+{
+  Segment *s;
+
+  m->segs  = growarray(m->segs, m->nsegs, sizeof(Segment));
+  s        = &m->segs[m->nsegs++];
+  s->x     = x;
+  s->click = click;
+  s->arg   = arg;
+}
+
+/* Runs func(arg) after ms milliseconds, and then every interval
+ * milliseconds unless interval is 0.  One-shot timers are freed after
+ * they fired, repeating ones must be removed with deltimer(). */
+static Timer *
+addtimer(unsigned int ms, unsigned int interval,
+         void (*func)(void *), void *arg)
+{
+  Timer **tp, *t;
+
+  if (!(t = calloc(1, sizeof(Timer))))
+    die("fatal: could not malloc() %u bytes\n", sizeof(Timer));
+
+  t->when     = clockms() + ms;
+  t->interval = interval;
+  t->func     = func;
+  t->arg      = arg;
+
+  for (tp = &timers;  *tp && (*tp)->when <= t->when;  tp = &(*tp)->next)
+    /* NOTHING */;
+
+  t->next = *tp;
+  *tp     = t;
+
+  return t;
+}
+
+/* Makes the main loop call func(fd, revents, arg) whenever poll(2)
+ * reports one of events for fd. */
+static bool
+addwatch(int fd, short events, void (*func)(int, short, void *),
+         void *arg)
+{
+  if (nwatches >= MAXWATCHES)
+    return false;
+
+  pfds[nwatches].fd      = fd;
+  pfds[nwatches].events  = events;
+  pfds[nwatches].revents = 0;
+  watches[nwatches].func = func;
+  watches[nwatches].arg  = arg;
+  nwatches++;
+
+  return true;
+}
+
 static void
 applyrules(Client *c)
 {
@@ -633,9 +1279,9 @@ applyrules(Client *c)
             ? role
             : broken;
 
-  for (i = 0; i < LENGTH(rules); i++)
+  for (i = 0; i < cfg.nrules; i++)
   {
-    r = &rules[i];
+    r = &cfg.rules[i];
 
     if (   (!r->title    || strstr(c->name,  r->title))
         && (!r->class    || strstr(class,    r->class))
@@ -822,6 +1468,45 @@ attachstack(Client *c)
   c->mon->stack = c;
 }
 
+#ifdef IPC
+static void
+bufappend(Buffer *b, const void *data, size_t len)
+{
+  char   *p;
+  size_t  size;
+
+  if (b->len + len > b->size)
+  {
+    for (size = b->size ? b->size : 256;  size < b->len + len;  size *= 2)
+      /* NOTHING */;
+
+    if (!(p = realloc(b->data, size)))
+      die("fatal: could not realloc() %u bytes\n", size);
+
+    b->data = p;
+    b->size = size;
+  }
+
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+}
+
+static void
+bufprintf(Buffer *b, const char *fmt, ...)
+{
+  va_list ap;
+  char    buf[512];
+  int     n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+
+  if (n > 0)
+    bufappend(b, buf, MIN((size_t)n, sizeof(buf) - 1));
+}
+#endif /* IPC */
+
 static void
 bstack(Monitor *m)
 {
@@ -955,40 +1640,23 @@ buttonpress(XEvent *e)
     focus(NULL);
   }
 
-  if (ev->window == selmon->barwin)
+  if (ev->window == selmon->barwin  &&  selmon->nsegs)
   {
-    unsigned int i = 0, occ = 0;
-    int          x = 0;
-
-    for (c = m->clients; c; c = c->next)
-      occ |= (c->tags == 255) ? 0 : c->tags;
+    unsigned int lo = 0, hi = selmon->nsegs, mid;
 
-    do
+    /* the last segment starting left of the click */
+    while (hi - lo > 1)
     {
-      /* do not reserve space for vacant tags */
-      if (!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
-        continue;
-
-      x += TEXTW(tags[m->num][i].tagname);
-
-    } while (ev->x >= x && ++i < TAGS);
-
-    if (i < TAGS)
-    {
-      click  = ClkTagBar;
-      arg.ui = 1 << i;
+      mid = (lo + hi) / 2;
+      if (selmon->segs[mid].x <= ev->x)
+        lo = mid;
+      else
+        hi = mid;
     }
-    else if (ev->x < x + blw)
-      click = ClkLtSymbol;
-#ifdef WINTITLE
-    else if (ev->x > selmon->ww - TEXTW(stext))
-      click = ClkStatusText;
-    else
-      click = ClkWinTitle;
-#else
-    else
-      click = ClkStatusText;
-#endif /* WINTITLE */
+
+    click = selmon->segs[lo].click;
+    if (click == ClkTagBar)
+      arg.ui = selmon->segs[lo].arg;
   }
   else if ((c = wintoclient(ev->window)))
   {
@@ -996,18 +1664,18 @@ buttonpress(XEvent *e)
     click = ClkClientWin;
   }
 
-  for (size_t i = 0; i < LENGTH(buttons); i++)
+  for (size_t i = 0; i < cfg.nbuttons; i++)
   {
-    if (   click                      == buttons[i].click
-        && buttons[i].func
-        && buttons[i].button          == ev->button
-        && CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state)
+    if (   click                          == cfg.buttons[i].click
+        && cfg.buttons[i].func
+        && cfg.buttons[i].button          == ev->button
+        && CLEANMASK(cfg.buttons[i].mask) == CLEANMASK(ev->state)
         )
     {
-      buttons[i].func(
-        (click == ClkTagBar && buttons[i].arg.i == 0)
+      cfg.buttons[i].func(
+        (click == ClkTagBar && cfg.buttons[i].arg.i == 0)
           ? &arg
-          : &buttons[i].arg
+          : &cfg.buttons[i].arg
           );
     }
   }
@@ -1025,12 +1693,32 @@ checkotherwm(void)
   XSync(dpy, false);
 }
 
+/* Returns a monotonic time stamp in milliseconds. */
+static long long
+clockms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 static void
 cleanup(void)
 {
-  Arg      a   = { .ui = ~0 };
-  Layout   foo = { "", NULL };
-  Monitor *m;
+  Arg            a   = { .ui = ~0 };
+  Layout         foo = { "", NULL };
+  Monitor       *m;
+  Window         win;
+  Client        *c;
+  unsigned long  seq;
+
+  /* hidden scratchpads are left visible */
+  for (m = mons;  m;  m = m->next)
+    for (c = m->clients;  c;  c = c->next)
+      if (c->scratch)
+        c->tags = TAGMASK;
 
   view(&a);
   selmon->lt[selmon->sellt] = &foo;
@@ -1038,11 +1726,22 @@ cleanup(void)
   for (m = mons;  m;  m = m->next)
   {
     while (m->stack)
+    {
+      /* nobody would ever see the windows of the warm pools */
+      win = m->stack->pool ? m->stack->win : None;
       unmanage(m->stack, false);
+      if (win)
+      {
+        seq = ignorebegin();
+        XKillClient(dpy, win);
+        ignoreend(seq);
+      }
+    }
   }
 
   XUngrabKey(dpy, AnyKey, AnyModifier, root);
-  XFreePixmap(dpy, dc.drawable);
+  if (statuspix)
+    XFreePixmap(dpy, statuspix);
   XFreeGC(dpy, dc.gc);
   XFreeCursor(dpy, cursor[CurNormal]);
   XFreeCursor(dpy, cursor[CurResize]);
@@ -1052,7 +1751,7 @@ cleanup(void)
     cleanupmon(mons);
 
 #ifdef SYSTRAY
-  if (showsystray)
+  if (showsystray  &&  systray)
   {
     XUnmapWindow(dpy, systray->win);
     XDestroyWindow(dpy, systray->win);
@@ -1060,6 +1759,21 @@ cleanup(void)
   }
 #endif /* SYSTRAY */
 
+#ifdef IPC
+  ipccleanup();
+#endif /* IPC */
+  statuscleanup();
+
+  while (timers)
+    deltimer(timers);
+
+  freeconfig(&cfg);
+
+  if (prompt.fd >= 0)
+    close(prompt.fd);
+
+  posix_spawnattr_destroy(&spawnattr);
+
   XSync(dpy, false);
   XSetInputFocus(dpy, PointerRoot, RevertToPointerRoot, CurrentTime);
   XDeleteProperty(dpy, root, netatom[NetActiveWindow]);
@@ -1082,6 +1796,14 @@ cleanupmon(Monitor *mon)
 
   XUnmapWindow(dpy, mon->barwin);
   XDestroyWindow(dpy, mon->barwin);
+  if (mon->barpix)
+    XFreePixmap(dpy, mon->barpix);
+  free(mon->segs);
+
+#ifdef SYSTRAY
+  if (systray  &&  systray->mon == mon)
+    systray->mon = NULL;
+#endif /* SYSTRAY */
 
   if (mon->pertag)
     free(mon->pertag);
@@ -1092,16 +1814,18 @@ cleanupmon(Monitor *mon)
 static void
 clearurgent(Client *c)
 {
-  XWMHints *wmh;
+#ifdef IPC
+  if (c->isurgent)
+    ipcevent(EvUrgent, c->mon, "%#lx 0", c->win);
+#endif /* IPC */
 
   c->isurgent = false;
 
-  if (!(wmh = XGetWMHints(dpy, c->win)))
+  if (!c->haswmh)
     return;
 
-  wmh->flags &= ~XUrgencyHint;
-  XSetWMHints(dpy, c->win, wmh);
-  XFree(wmh);
+  c->wmh.flags &= ~XUrgencyHint;
+  XSetWMHints(dpy, c->win, &c->wmh);
 }
 
 static void
@@ -1113,6 +1837,8 @@ clientmessage(XEvent *e)
 #ifdef SYSTRAY
   XWindowAttributes    wa;
   XSetWindowAttributes swa;
+  Client             **i;
+
   if (   showsystray
       && cme->window       == systray->win
       && cme->message_type == netatom[NetSystemTrayOP]
@@ -1126,8 +1852,12 @@ clientmessage(XEvent *e)
 
       c->win  = cme->data.l[2];
       c->mon  = selmon;
-      c->next = systray->icons;
-      systray->icons = c;
+
+      /* append, so the icons already docked keep their position */
+      for (i = &systray->icons;  *i;  i = &(*i)->next)
+        /* NOTHING */;
+      *i = c;
+
       XGetWindowAttributes(dpy, c->win, &wa);
       c->x = c->oldx = c->y = c->oldy = 0;
       c->w = c->oldw = wa.width;
@@ -1161,7 +1891,8 @@ clientmessage(XEvent *e)
       sendevent(c->win, netatom[Xembed], StructureNotifyMask,
           CurrentTime, XEMBED_MODALITY_ON, 0 , systray->win,
           XEMBED_EMBEDDED_VERSION);
-      resizebarwin(selmon);
+      XMapRaised(dpy, c->win);
+      setsystraydirty(c);
       updatesystray();
       setclientstate(c, NormalState);
     }
@@ -1196,6 +1927,21 @@ clientmessage(XEvent *e)
   }
 }
 
+/* Returns a copy of str which is freed with c. */
+static char *
+configstr(Config *c, const char *str)
+{
+  char *p;
+
+  if (!(p = strdup(str)))
+    die("fatal: could not malloc() %u bytes\n", strlen(str) + 1);
+
+  c->mem            = growarray(c->mem, c->nmem, sizeof(void *));
+  c->mem[c->nmem++] = p;
+
+  return p;
+}
+
 static void
 configure(Client *c)
 {
@@ -1230,15 +1976,6 @@ configurenotify(XEvent *e)
 
     if (updategeom() || dirty)
     {
-      if (dc.drawable != 0)
-        XFreePixmap(dpy, dc.drawable);
-
-      dc.drawable = XCreatePixmap(dpy,
-                                  root,
-                                  sw,
-                                  bh,
-                                  DefaultDepth(dpy, screen)
-                                  );
       updatebars();
 
       for (m = mons;  m;  m = m->next)
@@ -1249,6 +1986,9 @@ configurenotify(XEvent *e)
         XMoveResizeWindow(dpy, m->barwin, m->wx, m->by, m->ww, bh);
 #endif /* SYSTRAY */
       }
+#ifdef SYSTRAY
+      updatesystray();
+#endif /* SYSTRAY */
       focus(NULL);
       arrange(NULL);
     }
@@ -1339,6 +2079,7 @@ createmon(int idx)
   m->mfact      = mfact;
   m->nmaster    = nmaster;
   m->showbar    = showbar;
+  m->statusx    = -1;
   m->topbar     = topbar;
   m->lt[0]      = &layouts[ tags[m->num][0].layout_idx ]; /* current */
   m->lt[1]      = &layouts[1 % LENGTH(layouts)];          /* previous = float */
@@ -1377,6 +2118,33 @@ createmon(int idx)
   return m;
 }
 
+static void
+deltimer(Timer *t)
+{
+  Timer **tp;
+
+  for (tp = &timers;  *tp && *tp != t;  tp = &(*tp)->next)
+    /* NOTHING */;
+
+  if (*tp)
+  {
+    *tp = t->next;
+    free(t);
+  }
+}
+
+/* Removes the watch of fd, the main loop drops it before polling
+ * again. */
+static void
+delwatch(int fd)
+{
+  int i;
+
+  for (i = 0;  i < nwatches;  i++)
+    if (pfds[i].fd == fd)
+      pfds[i].fd = -1;
+}
+
 static void
 destroynotify(XEvent *e)
 {
@@ -1389,7 +2157,6 @@ destroynotify(XEvent *e)
   else if ((c = wintosystrayicon(ev->window)))
   {
     removesystrayicon(c);
-    resizebarwin(selmon);
     updatesystray();
   }
 #endif /* SYSTRAY */
@@ -1469,227 +2236,306 @@ dirtomon(int dir)
   return m;
 }
 
+/* Writes to path the value of the environment variable var if it is
+ * set, fmt with %s replaced by the display name otherwise.  A relative
+ * fmt is taken in $XDG_RUNTIME_DIR, or /tmp if it is unset.  A value
+ * exported by rawm on another display, as inherited by a nested
+ * session, is ignored. */
+static bool
+displaypath(char *path, size_t size, const char *fmt, const char *var)
+{
+  const char *env, *name, *owner, *dir;
+  char        display[64], *p;
+  int         n, m;
+
+  name  = (env = getenv("DISPLAY")) ? env : "";
+  owner = getenv("RAWM_DISPLAY");
+
+  if (   (env = getenv(var))  &&  *env
+      && (!owner  ||  !strcmp(owner, name)))
+    return snprintf(path, size, "%s", env) < (int)size;
+
+  snprintf(display, sizeof(display), "%s", name);
+  for (p = display;  *p;  p++)
+    if (*p == '/')
+      *p = '_';
+
+  /* an empty fmt stays empty */
+  if (!*fmt  ||  *fmt == '/')
+    dir = "";
+  else if (!(dir = getenv("XDG_RUNTIME_DIR"))  ||  !*dir)
+    dir = "/tmp";
+
+  n = snprintf(path, size, "%s%s", dir, *dir ? "/" : "");
+  if (n < 0  ||  n >= (int)size)
+    return false;
+
+  m = snprintf(path + n, size - n, fmt, display);
+
+  return m >= 0  &&  m < (int)size - n;
+}
+
+/* Schedules a redraw of the bar of m at the next frame. */
 static void
 drawbar(Monitor *m)
 {
-  int           x;
-  unsigned int  i, occ = 0, urg = 0;
-  XftColor     *col;
-  Client       *c;
+  m->bardirty = true;
+  barrequests++;
+}
 
-#ifdef SYSTRAY
-  resizebarwin(m);
-#endif /* SYSTRAY */
+/* Draws the spans of b at dc.x, in at most dc.w pixels. */
+static void
+drawblock(Block *b)
+{
+  unsigned int  i;
+  int           x, l, r, end, h;
+  Span         *s;
 
-  for (c = m->clients;  c;  c = c->next)
+  h   = dc.font.ascent + dc.font.descent;
+  end = dc.x + dc.w;
+
+  for (i = 0, x = dc.x + h / 2;  i < b->nspans;  x += b->spans[i++].w)
   {
-    occ |= c->tags == 255 ? 0 : c->tags;
-    if (c->isurgent)
-      urg |= c->tags;
+    s = &b->spans[i];
+
+    /* the first and last spans also cover the padding */
+    l = i ? x : dc.x;
+    r = i + 1 < b->nspans ? MIN(x + s->w, end) : end;
+    if (r <= l)
+      break;
+
+    XSetForeground(dpy, dc.gc, s->col[ColBG].pixel);
+    XFillRectangle(dpy, dc.drawable, dc.gc, l, dc.y, r - l, dc.h);
+    drawstring(b->text + s->off, s->len, s->w, x, end - h / 2 - x, s->col);
   }
+}
 
-  dc.x = 0;
+/* Redraws the bars whose content changed since their last renderbar(). */
+static void
+drawbars(void)
+{
+  BarState  bs;
+  Monitor  *m;
 
-  for (i = 0; i < TAGS; i++)
+  for (m = mons; m; m = m->next)
   {
-    /* do not draw vacant tags */
-    if (!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
+    if (m->bardirty)
       continue;
 
-    dc.w = TEXTW(tags[m->num][i].tagname);
+    getbarstate(m, &bs);
+
+    if (   bs.sel      != m->bar.sel
+        || bs.seltags  != m->bar.seltags
+        || bs.occ      != m->bar.occ
+        || bs.urg      != m->bar.urg
+        || bs.tagset   != m->bar.tagset
+        || bs.isselmon != m->bar.isselmon
+        || bs.selfixed    != m->bar.selfixed
+        || bs.selfloating != m->bar.selfloating
+        || bs.w        != m->bar.w
+        || strcmp(bs.ltsymbol, m->bar.ltsymbol)
+        )
+      drawbar(m);
+  }
 
-    col = dc.colors[ (  m->tagset[ m->seltags ] & 1 << i
-                      ? 1
-                      : (urg & 1 << i ? 2 : 0)
-                      ) ];
+#ifdef SYSTRAY
+  /* the systray follows the selected monitor */
+  if (showsystray  &&  systray  &&  systray->mon != selmon)
+    updatesystray();
+#endif /* SYSTRAY */
+}
 
-    drawtext(tags[m->num][i].tagname, col, true);
+static void
+drawsquare(bool filled, bool empty, XftColor col[ColLast])
+{
+  int x;
 
-    drawsquare(   m == selmon
-               && selmon->sel
-               && selmon->sel->tags & 1 << i,
-               occ & 1 << i,
-               col
-               );
+  XSetForeground(dpy, dc.gc, col[ColFG].pixel);
 
-    dc.x += dc.w;
-  }
+  x = (dc.font.ascent + dc.font.descent + 2) / 4;
 
-  /*
-   * draw layout
-   */
+  if (filled)
+    XFillRectangle(dpy, dc.drawable, dc.gc, dc.x+1, dc.y+1, x+1, x+1);
+  else if (empty)
+    XDrawRectangle(dpy, dc.drawable, dc.gc, dc.x+1, dc.y+1, x,   x);
+}
 
-  /* tiled layout: []= X
-   * where X is the number of clients in master area */
-  if (m->lt[m->sellt]->arrange == tile)
-    snprintf(m->ltsymbol, sizeof m->ltsymbol, "[]= %d", m->nmaster);
+/* Draws the status blocks from x on, in at most w pixels. */
+static void
+drawstatus(int x, int w)
+{
+  unsigned int i;
+  int          ox = x;
 
-  /* float/monocle layout: [X/Y] or <X/Y>
-   * where X is the current window number, and Y is the number of
-   * clients in master area */
-  else if (  (   m->lt[m->sellt]->arrange == monocle
-              || m->lt[m->sellt]->arrange == NULL )
-           && m == selmon /* update only on selected monitor */
-           )
+  for (i = 0;  i < nblocks  &&  w > 0;  i++)
   {
-    unsigned int i = 0, j = 0;
-
-    for (c = selmon->clients;  c;  c = c->next)
-    {
-      if (ISVISIBLE(c))
-      {
-        i++;
-        if (c->win == selmon->sel->win)
-          j = i;
-      }
-    }
+    blocks[i].dirty = false;
+    if (!blocks[i].w)
+      continue;
 
-    if (m->lt[m->sellt]->arrange == NULL)
-      snprintf(m->ltsymbol, sizeof m->ltsymbol, "<%u/%u>", j, i);
-    else
-      snprintf(m->ltsymbol, sizeof m->ltsymbol, "[%u/%u]", j, i);
+    dc.x = x;
+    dc.w = MIN(blocks[i].w, w);
+    drawblock(&blocks[i]);
+    x   += dc.w;
+    w   -= dc.w;
   }
 
-  else if (m->lt[m->sellt]->arrange == bstack)
-    snprintf(m->ltsymbol, sizeof m->ltsymbol, "TTT %d", m->nmaster);
-
-  else if (m->lt[m->sellt]->arrange == bstackhoriz)
-    snprintf(m->ltsymbol, sizeof m->ltsymbol, "=== %d", m->nmaster);
+  dc.x = ox;
+}
 
-  else if (m->lt[m->sellt]->arrange == gaplessgrid)
-    snprintf(m->ltsymbol, sizeof m->ltsymbol, "###");
+#ifdef HARFBUZZ
+/* Draws len bytes of text, tw pixels wide, at x in the foreground
+ * color of col.  Text wider than w pixels is cut between two glyph
+ * clusters and ended with dots. */
+static void
+drawstring(const char *text, int len, int tw, int x, int w,
+           XftColor col[ColLast])
+{
+  XftGlyphSpec  sbuf[64], *specs;
+  XftDraw      *d;
+  XftFont      *f;
+  Shaped       *s;
+  unsigned int  i, j;
+  int           y, n, off, pen = 0;
+  bool          cut = false;
+
+  /* leave room for the dots */
+  if (tw > w  &&  (w -= textnw("...", 3)) < 0)
+    return;
 
-  dc.w  = blw = TEXTW(m->ltsymbol);
-  drawtext(m->ltsymbol, dc.colors[0], true);
-  dc.x += dc.w;
-  x     = dc.x;
+  y = dc.y + (dc.h + dc.font.ascent - dc.font.descent) / 2;
+  d = XftDrawCreate(dpy,
+                    dc.drawable,
+                    DefaultVisual(dpy, screen),
+                    DefaultColormap(dpy, screen)
+                    );
 
-  if (m == selmon)
+  for (off = 0;  off < len  &&  !cut;  off += n)
   {
-    /* status is only drawn on selected monitor */
-    dc.w = TEXTW(stext);
-    dc.x = m->ww - dc.w;
+    n = fontrun(text + off, len - off, &f);
+    s = shaperun(text + off, n, f);
 
-#ifdef SYSTRAY
-    if (showsystray  &&  m == selmon)
-      dc.x -= getsystraywidth();
-#endif /* SYSTRAY */
-
-    if (dc.x < x)
+    /* the glyphs of a cluster are kept together */
+    for (i = 0;  i < s->nglyphs;  i = j)
     {
-      dc.x = x;
-      dc.w = m->ww - x;
+      for (j = i + 1;
+           j < s->nglyphs  &&  s->clusters[j] == s->clusters[i];
+           j++)
+        /* NOTHING */;
+
+      if (tw > w  &&  pen + s->pen[j] > w)
+      {
+        cut = true;
+        break;
+      }
     }
-    drawcoloredtext(stext);
-  }
-  else
-    dc.x = m->ww;
 
-  if ((dc.w = dc.x - x) > bh)
-  {
-    dc.x = x;
-#ifdef WINTITLE
-    if (m->sel)
+    specs = sbuf;
+    if (i > LENGTH(sbuf)  &&  !(specs = malloc(i * sizeof(XftGlyphSpec))))
+      die("fatal: could not malloc() %u bytes\n", i * sizeof(XftGlyphSpec));
+
+    for (j = 0;  j < i;  j++)
     {
-      /* is monitor selected? draw dc.colors[1] then */
-      col = m == selmon ? dc.colors[1] : dc.colors[0];
-      drawtext(m->sel->name, col, true);
+      specs[j].glyph = s->specs[j].glyph;
+      specs[j].x     = x + pen + s->specs[j].x;
+      specs[j].y     = y + s->specs[j].y;
+    }
 
-      drawsquare(m->sel->isfixed, m->sel->isfloating, col);
+    XftDrawGlyphSpec(d, &col[ColFG], f, specs, i);
+    pen += s->pen[i];
 
-      /* or draw normal colors, no matter what monitor it is */
-      //drawtext(m->sel->name, dc.colors[0], true);
-      //drawsquare(m->sel->isfixed, m->sel->isfloating, dc.colors[1]);
-    }
-    else
-#endif /* WINTITLE */
-      drawtext(NULL, dc.colors[0], false);
+    if (specs != sbuf)
+      free(specs);
   }
 
-  XCopyArea(dpy, dc.drawable, m->barwin, dc.gc, 0, 0, m->ww, bh, 0, 0);
-  XSync(dpy, false);
-}
+  if (cut)
+    XftDrawStringUtf8(d, &col[ColFG], dc.font.xfont, x + pen, y,
+                      (XftChar8 *)"...", 3);
 
+  XftDrawDestroy(d);
+}
+#else
+/* Draws len bytes of text, tw pixels wide, at x in the foreground
+ * color of col, shortened to fit in w pixels if necessary. */
 static void
-drawbars(void)
+drawstring(const char *text, int len, int tw, int x, int w,
+           XftColor col[ColLast])
 {
-  Monitor *m;
+  char        sbuf[256], *buf = sbuf;
+  int         y, olen = len, lo, hi, n, off;
+  XftDraw    *d;
+  XftFont    *f;
+  XGlyphInfo  ext;
 
-  for (m = mons; m; m = m->next)
-    drawbar(m);
+  y = dc.y + (dc.h + dc.font.ascent - dc.font.descent) / 2;
 
-#ifdef SYSTRAY
-  updatesystray();
-#endif /* SYSTRAY */
-}
+  /* shorten text if necessary, to the longest prefix that fits */
+  if (tw > w)
+  {
+    for (lo = 0, hi = olen - 1;  lo < hi; )
+    {
+      len = (lo + hi + 1) / 2;
+      if (textnw(text, len) > w)
+        hi = len - 1;
+      else
+        lo = len;
+    }
+    len = lo;
+  }
 
-static void
-drawcoloredtext(char *text)
-{
-  bool first = true;
-  char *buf = text, *ptr = buf, c = 1;
-  XftColor *col = dc.colors[0];
-  int i, ox = dc.x;
+  if (!len)
+    return;
 
-  while (*ptr)
+  if (len == olen)
+    buf = (char *)text;
+  else
   {
-    for (i = 0; *ptr < 0 || *ptr > NUMCOLORS; i++, ptr++)
+    if (len > (int)sizeof(sbuf)  &&  !(buf = malloc(len)))
+      die("fatal: could not malloc() %u bytes\n", len);
+
+    memcpy(buf, text, len);
+    for (int i = len;  i && (i > (len - 3));  buf[--i] = '.')
       /* NOTHING */;
+  }
 
-    if (!*ptr)
-      break;
+  d = XftDrawCreate(dpy,
+                    dc.drawable,
+                    DefaultVisual(dpy, screen),
+                    DefaultColormap(dpy, screen)
+                    );
 
-    c = *ptr;
-    *ptr = 0;
+  /* draw the runs of each font one after the other */
+  for (off = 0;  off < len;  off += n)
+  {
+    n = fontrun(buf + off, len - off, &f);
 
-    if (i)
-    {
-      dc.w = selmon->ww - dc.x;
-      drawtext(buf, col, first);
-      dc.x += textnw(buf, i) + textnw(&c,1);
-      if (first)
-        dc.x += (dc.font.ascent + dc.font.descent) / 2;
+    XftDrawStringUtf8(d,
+                      &col[ColFG],
+                      f,
+                      x,
+                      y,
+                      (XftChar8 *)buf + off,
+                      n
+                      );
 
-      first = false;
-    }
-    else if (first)
+    if (off + n < len)
     {
-      ox = dc.x += textnw(&c,1);
+      XftTextExtentsUtf8(dpy, f, (XftChar8 *)buf + off, n, &ext);
+      x += ext.xOff;
     }
-
-    *ptr = c;
-    col = dc.colors[ c-1 ];
-    buf = ++ptr;
   }
 
-  if (!first)
-    dc.x -= (dc.font.ascent + dc.font.descent) / 2;
-
-  drawtext(buf, col, true);
-  dc.x = ox;
-}
-
-static void
-drawsquare(bool filled, bool empty, XftColor col[ColLast])
-{
-  int x;
-
-  XSetForeground(dpy, dc.gc, col[ColFG].pixel);
-
-  x = (dc.font.ascent + dc.font.descent + 2) / 4;
+  XftDrawDestroy(d);
 
-  if (filled)
-    XFillRectangle(dpy, dc.drawable, dc.gc, dc.x+1, dc.y+1, x+1, x+1);
-  else if (empty)
-    XDrawRectangle(dpy, dc.drawable, dc.gc, dc.x+1, dc.y+1, x,   x);
+  if (buf != sbuf  &&  buf != text)
+    free(buf);
 }
+#endif /* HARFBUZZ */
 
 static void
 drawtext(const char *text, XftColor col[ColLast], bool pad)
 {
-  char     buf[256];
-  int      x, y, h, len, olen;
-  XftDraw *d;
+  int h, len;
 
   XSetForeground(dpy, dc.gc, col[ColBG].pixel);
   XFillRectangle(dpy, dc.drawable, dc.gc, dc.x, dc.y, dc.w, dc.h);
@@ -1697,44 +2543,9 @@ drawtext(const char *text, XftColor col[ColLast], bool pad)
   if (!text)
     return;
 
-  olen = strlen(text);
-  h = pad ? (dc.font.ascent + dc.font.descent) : 0;
-  y = dc.y + (dc.h + dc.font.ascent - dc.font.descent) / 2;
-  x = dc.x + (h / 2);
-
-  /* shorten text if necessary */
-  for (len = MIN(olen, sizeof buf);
-       len  &&  (textnw(text, len) > (dc.w - h));
-       len--)
-    /* NOTHING */;
-
-  if (!len)
-    return;
-
-  memcpy(buf, text, len);
-
-  if (len < olen)
-  {
-    for (int i = len;  i && (i > (len - 3));  buf[--i] = '.')
-      /* NOTHING */;
-  }
-
-  d = XftDrawCreate(dpy,
-                    dc.drawable,
-                    DefaultVisual(dpy, screen),
-                    DefaultColormap(dpy, screen)
-                    );
-
-  XftDrawStringUtf8(d,
-                    &col[ColFG],
-                    dc.font.xfont,
-                    x,
-                    y,
-                    (XftChar8 *)buf,
-                    len
-                    );
-
-  XftDrawDestroy(d);
+  len = strlen(text);
+  h   = pad ? (dc.font.ascent + dc.font.descent) : 0;
+  drawstring(text, len, textnw(text, len), dc.x + h / 2, dc.w - h, col);
 }
 
 static void
@@ -1765,16 +2576,136 @@ enternotify(XEvent *e)
   focus(c);
 }
 
+/* Shows the damaged part of a bar again from its pixmap, without
+ * drawing anything. */
 static void
 expose(XEvent *e)
 {
   Monitor      *m;
   XExposeEvent *ev = &e->xexpose;
 
-  if (    ev->count == 0
-      && (m = wintomon(ev->window))
-      )
+  for (m = mons;  m  &&  m->barwin != ev->window;  m = m->next)
+    /* NOTHING */;
+
+  if (!m  ||  m->bardirty)
+    return;
+
+  if (!m->barpix)
+  {
     drawbar(m);
+    return;
+  }
+
+  XCopyArea(dpy, m->barpix, m->barwin, dc.gc, ev->x, ev->y,
+            ev->width, ev->height, ev->x, ev->y);
+  barblits++;
+}
+
+/* Renders the bars and status blocks changed since the last frame,
+ * at most once every barinterval milliseconds however often they
+ * change, and returns the time in milliseconds until the next frame
+ * is due, or -1 if nothing waits for one. */
+static int
+flushbars(void)
+{
+  long long  now;
+  Monitor   *m;
+
+  for (m = mons;  m && !m->bardirty;  m = m->next)
+    /* NOTHING */;
+
+  if (!m  &&  !statusdirty)
+    return -1;
+
+  if ((now = clockms()) < barframe + barinterval)
+    return barframe + barinterval - now;
+
+  barframe = now;
+  flushstatus();
+
+  for (m = mons;  m;  m = m->next)
+    if (m->bardirty)
+      renderbar(m);
+
+  return -1;
+}
+
+/* Draws the blocks changed by setblock() into statuspix, once per
+ * frame of flushbars(), and copies them to every bar showing the
+ * status.  Changed blocks keeping their width are copied as one
+ * rectangle, the bars are redrawn if the layout of the status
+ * changed. */
+static void
+flushstatus(void)
+{
+  unsigned int  i;
+  int           x, lo = -1, hi = 0;
+  Monitor      *m;
+
+  if (!statusdirty)
+    return;
+
+  statusdirty = false;
+
+  if (statusfull)
+  {
+    statusfull = false;
+
+    if (statuspixw != statusw)
+    {
+      if (statuspix)
+        XFreePixmap(dpy, statuspix);
+
+      statuspixw = statusw;
+      statuspix  = XCreatePixmap(dpy, root, MAX(statusw, 1), bh,
+                                 DefaultDepth(dpy, screen));
+    }
+
+    dc.drawable = statuspix;
+    drawstatus(0, statusw);
+
+    for (m = mons;  m;  m = m->next)
+      if (SHOWSTATUS(m))
+        drawbar(m);
+    return;
+  }
+
+  dc.drawable = statuspix;
+  for (i = 0, x = 0;  i < nblocks;  x += blocks[i++].w)
+  {
+    if (!blocks[i].dirty)
+      continue;
+
+    blocks[i].dirty = false;
+    dc.x = x;
+    dc.w = blocks[i].w;
+    drawblock(&blocks[i]);
+
+    if (lo < 0)
+      lo = x;
+    hi = x + blocks[i].w;
+  }
+
+  if (lo < 0)
+    return;
+
+  for (m = mons;  m;  m = m->next)
+  {
+    if (!SHOWSTATUS(m)  ||  m->bardirty)
+      continue;
+
+    if (m->statusx < 0)
+    {
+      drawbar(m);
+      continue;
+    }
+
+    XCopyArea(dpy, statuspix, m->barpix, dc.gc, lo, 0, hi - lo, bh,
+              m->statusx + lo, 0);
+    XCopyArea(dpy, m->barpix, m->barwin, dc.gc, m->statusx + lo, 0,
+              hi - lo, bh, m->statusx + lo, 0);
+    barblits++;
+  }
 }
 
 static void
@@ -1801,8 +2732,12 @@ focus(Client *c)
       clearurgent(c);
 
 #ifdef PWKL
-    XkbLockGroup(dpy, XkbUseCoreKbd, c->kbdgrp);
-#endif
+    if (c->kbdgrp != kbdgrp)
+    {
+      XkbLockGroup(dpy, XkbUseCoreKbd, c->kbdgrp);
+      kbdgrp = c->kbdgrp;
+    }
+#endif /* PWKL */
 
     detachstack(c);
     attachstack(c);
@@ -1923,10 +2858,76 @@ focusstack(const Arg *arg)
   }
 }
 
-static void
-gaplessgrid(Monitor *m)
+/* Initializes fontconfig, which reads its configuration and caches
+ * from disk, in parallel to the X round trips of startup. */
+static void *
+fontinit(__attribute__((unused)) void *arg)
 {
-  int     n, cols, rows, cn, rn, i, cx, cy, cw, ch;
+  FcInit();
+
+  return NULL;
+}
+
+/* Returns the length of the longest prefix of the len bytes of text
+ * whose glyphs are taken from the same font, which is stored in f. */
+static int
+fontrun(const char *text, int len, XftFont **f)
+{
+  FcChar32      cp;
+  unsigned int  i, run = 0;
+  int           n, off;
+
+  if (dc.font.nxfonts == 1)
+  {
+    *f = dc.font.xfont;
+    return len;
+  }
+
+  for (off = 0;  off < len;  off += n)
+  {
+    if ((unsigned char)text[off] < 0x80)
+    {
+      cp = text[off];
+      n  = 1;
+    }
+    else if ((n = FcUtf8ToUcs4((const FcChar8 *)text + off, &cp,
+                               len - off)) <= 0)
+    {
+      /* a broken sequence, maybe cut by drawstring() */
+      cp = 0xfffd;
+      n  = 1;
+    }
+
+    i = glyphfont(cp);
+    if (!off)
+      run = i;
+    else if (i != run)
+      break;
+  }
+
+  *f = dc.font.xfonts[run];
+  return off;
+}
+
+static void
+freeconfig(Config *c)
+{
+  unsigned int i;
+
+  for (i = 0;  i < c->nmem;  i++)
+    free(c->mem[i]);
+
+  free(c->mem);
+  free(c->rules);
+  free(c->keys);
+  free(c->buttons);
+  memset(c, 0, sizeof(Config));
+}
+
+static void
+gaplessgrid(Monitor *m)
+{
+  int     n, cols, rows, cn, rn, i, cx, cy, cw, ch;
   Client *c;
 
   for (n = 0, c = nexttiled(m->clients);
@@ -2015,11 +3016,59 @@ getatomprop(Client *c, Atom prop)
   return atom;
 }
 
+static void
+getbarstate(Monitor *m, BarState *bs)
+{
+  Client *c;
+
+  bs->occ = bs->urg = 0;
+  for (c = m->clients;  c;  c = c->next)
+  {
+    bs->occ |= c->tags == 255 ? 0 : c->tags;
+    if (c->isurgent)
+      bs->urg |= c->tags;
+  }
+
+  bs->sel      = m->sel;
+  bs->seltags  = m->sel ? m->sel->tags : 0;
+  bs->tagset   = m->tagset[m->seltags];
+  bs->isselmon = m == selmon;
+  bs->selfixed    = m->sel  &&  m->sel->isfixed;
+  bs->selfloating = m->sel  &&  m->sel->isfloating;
+  bs->w        = m->ww;
+#ifdef SYSTRAY
+  if (showsystray  &&  m == selmon)
+    bs->w -= getsystraywidth();
+#endif /* SYSTRAY */
+
+  updateltsymbol(m);
+  strncpy(bs->ltsymbol, m->ltsymbol, sizeof bs->ltsymbol);
+}
+
 static XftColor
 getcolor(const char *colstr)
 {
-  Colormap cmap = DefaultColormap(dpy, screen);
-  XftColor color;
+  Colormap      cmap = DefaultColormap(dpy, screen);
+  XftColor      color;
+  XRenderColor  rc;
+  unsigned int  r, g, b;
+  int           n;
+
+  /* "#rrggbb" is converted here, which needs no round trip to the
+   * server on TrueColor visuals */
+  if (   strlen(colstr) == 7
+      && sscanf(colstr, "#%2x%2x%2x%n", &r, &g, &b, &n) == 3
+      && n == 7
+      )
+  {
+    rc.red   = r * 0x101;
+    rc.green = g * 0x101;
+    rc.blue  = b * 0x101;
+    rc.alpha = 0xffff;
+
+    if (XftColorAllocValue(dpy, DefaultVisual(dpy, screen), cmap, &rc, &color))
+      return color;
+  }
 
   if (!XftColorAllocName(dpy,
                          DefaultVisual(dpy, screen),
@@ -2043,6 +3092,40 @@ getrootptr(int *x, int *y)
   return XQueryPointer(dpy, root, &dummy, &dummy, x, y, &di, &di, &dui);
 }
 
+static SavedClient *
+getsaved(Window w)
+{
+  unsigned int i;
+
+  for (i = 0;  i < nsaved;  i++)
+    if (saved[i].win == w)
+      return &saved[i];
+
+  return NULL;
+}
+
+/* Returns the _NET_WM_PID of w, 0 if it has none. */
+static pid_t
+getwinpid(Window w)
+{
+  int            di;
+  unsigned long  dl, n;
+  unsigned char *p = NULL;
+  Atom           da;
+  pid_t          pid = 0;
+
+  if (XGetWindowProperty(dpy, w, netatom[NetWMPid], 0L, 1L, False,
+                         XA_CARDINAL, &da, &di, &n, &dl, &p) == Success
+      && p)
+  {
+    if (n)
+      pid = *(unsigned long *)p;
+    XFree(p);
+  }
+
+  return pid;
+}
+
 static long
 getstate(Window w)
 {
@@ -2081,39 +3164,26 @@ getstate(Window w)
 unsigned int
 getsystraywidth()
 {
-  unsigned int w = 0;
-  Client *i;
-
-  if (showsystray)
-  {
-    for (i = systray->icons;
-         i;
-         w += i->w + systrayspacing, i = i->next)
-      /* NOTHING */;
-  }
-
-  return w ? w + systrayspacing : 1;
+  return (showsystray  &&  systray  &&  systray->w) ? systray->w : 1;
 }
 #endif /* SYSTRAY */
 
-static bool
-gettextprop(Window w, Atom atom, char *text, unsigned int size)
+/* Returns the text property atom of w in a new string, of any length,
+ * or NULL if w has none. */
+static char *
+gettextdup(Window w, Atom atom)
 {
   int             n;
-  char          **list = NULL;
+  char          **list = NULL, *text = NULL;
   XTextProperty   name;
 
-  if (!text || size == 0)
-    return false;
-
-  text[0] = '\0';
   XGetTextProperty(dpy, w, &name, atom);
 
   if (!name.nitems)
-    return false;
+    return NULL;
 
   if (name.encoding == XA_STRING)
-    strncpy(text, (char *)name.value, size - 1);
+    text = strdup((char *)name.value);
   else
   {
     if (   (   XmbTextPropertyToTextList(dpy, &name, &list, &n)
@@ -2122,23 +3192,93 @@ gettextprop(Window w, Atom atom, char *text, unsigned int size)
         && *list
        )
     {
-      strncpy(text, *list, size - 1);
+      text = strdup(*list);
       XFreeStringList(list);
     }
+    else
+      text = strdup("");
   }
 
-  text[size - 1] = '\0';
   XFree(name.value);
 
+  if (!text)
+    die("fatal: could not malloc() %u bytes\n", name.nitems + 1);
+
+  return text;
+}
+
+static bool
+gettextprop(Window w, Atom atom, char *text, unsigned int size)
+{
+  char *s;
+
+  if (!text || size == 0)
+    return false;
+
+  text[0] = '\0';
+
+  if (!(s = gettextdup(w, atom)))
+    return false;
+
+  strncpy(text, s, size - 1);
+  text[size - 1] = '\0';
+  free(s);
+
   return true;
 }
 
+/* Returns the index of the first font having a glyph for cp, or 0 if
+ * none has.  Results are cached, so that the coverage of the fonts is
+ * only looked up once per codepoint. */
+static unsigned int
+glyphfont(FcChar32 cp)
+{
+  unsigned int h, i, probe;
+
+  h = (cp * 2654435761u) & (GLYPHCACHE - 1);
+  for (i = h, probe = 0;  probe < 8;  i = (i + 1) & (GLYPHCACHE - 1), probe++)
+  {
+    if (glyphs[i].key == cp + 1)
+      return glyphs[i].font;
+    if (!glyphs[i].key)
+      break;
+  }
+
+  /* replace the first entry if the probed ones are all taken */
+  if (probe == 8)
+    i = h;
+
+  glyphs[i].key  = cp + 1;
+  glyphs[i].font = 0;
+
+  for (h = 0;  h < dc.font.nxfonts;  h++)
+    if (XftCharExists(dpy, dc.font.xfonts[h], cp))
+    {
+      glyphs[i].font = h;
+      break;
+    }
+
+  return glyphs[i].font;
+}
+
+/* Makes room for element n of the array p, which grows in steps of
+ * 16 elements of the given size. */
+static void *
+growarray(void *p, unsigned int n, size_t size)
+{
+  if (n % 16)
+    return p;
+
+  if (!(p = realloc(p, (n + 16) * size)))
+    die("fatal: could not realloc() %u bytes\n", (n + 16) * size);
+
+  return p;
+}
+
 /* TODO: see upstream workaround */
 static void
 grabbuttons(Client *c, bool focused)
 {
-  updatenumlockmask();
-
   {
     unsigned int modifiers[] = {
       0,
@@ -2151,14 +3291,14 @@ grabbuttons(Client *c, bool focused)
 
     if (focused)
     {
-      for (unsigned int i = 0; i < LENGTH(buttons); i++)
+      for (unsigned int i = 0; i < cfg.nbuttons; i++)
       {
-        if (buttons[i].click == ClkClientWin)
+        if (cfg.buttons[i].click == ClkClientWin)
         {
           for (unsigned int j = 0; j < LENGTH(modifiers); j++)
             XGrabButton(dpy,
-                        buttons[i].button,
-                        buttons[i].mask | modifiers[j],
+                        cfg.buttons[i].button,
+                        cfg.buttons[i].mask | modifiers[j],
                         c->win,
                         false,
                         BUTTONMASK,
@@ -2188,8 +3328,6 @@ grabbuttons(Client *c, bool focused)
 static void
 grabkeys(void)
 {
-  updatenumlockmask();
-
   {
     unsigned int modifiers[] = {
       0,
@@ -2200,14 +3338,14 @@ grabkeys(void)
     KeyCode code;
 
     XUngrabKey(dpy, AnyKey, AnyModifier, root);
-    for (unsigned int i = 0; i < LENGTH(keys); i++)
+    for (unsigned int i = 0; i < cfg.nkeys; i++)
     {
-      if ((code = XKeysymToKeycode(dpy, keys[i].keysym)))
+      if ((code = XKeysymToKeycode(dpy, cfg.keys[i].keysym)))
       {
         for (unsigned int j = 0;  j < LENGTH(modifiers);  j++)
           XGrabKey(dpy,
                    code,
-                   keys[i].mod | modifiers[j],
+                   cfg.keys[i].mod | modifiers[j],
                    root,
                    true,
                    GrabModeAsync,
@@ -2218,6 +3356,39 @@ grabkeys(void)
   }
 }
 
+static bool
+hasprotocol(Client *c, Atom proto)
+{
+  for (int i = 0;  i < WMLast;  i++)
+  {
+    if (wmatom[i] == proto)
+      return c->protocols & (1 << i);
+  }
+
+  return false;
+}
+
+/* Requests issued between ignorebegin() and ignoreend() may refer to
+ * windows which are gone by the time the server processes them.
+ * Their errors are filtered by sequence number in xerror(), so no
+ * server grab or XSync is needed around them. */
+static unsigned long
+ignorebegin(void)
+{
+  return NextRequest(dpy);
+}
+
+static void
+ignoreend(unsigned long first)
+{
+  if (NextRequest(dpy) == first)
+    return; /* no requests issued */
+
+  ignored[nignored % MAXIGNORED].first = first;
+  ignored[nignored % MAXIGNORED].last  = NextRequest(dpy) - 1;
+  nignored++;
+}
+
 static void
 incnmaster(const Arg *arg)
 {
@@ -2231,6 +3402,15 @@ incnmaster(const Arg *arg)
 static void
 initfont(const char *fontstr)
 {
+  unsigned int  i;
+  XftFont      *f;
+
+  if (fontthreadrunning)
+  {
+    pthread_join(fontthread, NULL);
+    fontthreadrunning = false;
+  }
+
   if (   !(dc.font.xfont = XftFontOpenName(dpy, screen, fontstr))
       && !(dc.font.xfont = XftFontOpenName(dpy, screen, "fixed"))
       )
@@ -2239,8 +3419,557 @@ initfont(const char *fontstr)
   dc.font.ascent  = dc.font.xfont->ascent;
   dc.font.descent = dc.font.xfont->descent;
   dc.font.height  = dc.font.ascent + dc.font.descent;
+
+  /* the fallback fonts are matched once here, glyphfont() then only
+   * checks their coverage */
+  dc.font.xfonts[0] = dc.font.xfont;
+  dc.font.nxfonts   = 1;
+  for (i = 0;  i < LENGTH(fallbackfonts)  &&  dc.font.nxfonts < MAXFONTS;  i++)
+    if ((f = XftFontOpenName(dpy, screen, fallbackfonts[i])))
+      dc.font.xfonts[dc.font.nxfonts++] = f;
+
+#ifdef HARFBUZZ
+  /* the faces stay locked for the fonts of HarfBuzz */
+  for (i = 0;  i < dc.font.nxfonts;  i++)
+    dc.font.hbfonts[i] = hb_ft_font_create(XftLockFace(dc.font.xfonts[i]),
+                                           NULL);
+#endif /* HARFBUZZ */
+}
+
+/* Prepares the attributes of the children: they start in a new
+ * session without the handlers and the signal mask of rawm. */
+static void
+initspawn(void)
+{
+  sigset_t sigs;
+
+  posix_spawnattr_init(&spawnattr);
+#ifdef POSIX_SPAWN_SETSID
+  posix_spawnattr_setflags(&spawnattr, POSIX_SPAWN_SETSID
+                                     | POSIX_SPAWN_SETSIGMASK
+                                     | POSIX_SPAWN_SETSIGDEF);
+#else
+  posix_spawnattr_setflags(&spawnattr, POSIX_SPAWN_SETPGROUP
+                                     | POSIX_SPAWN_SETSIGMASK
+                                     | POSIX_SPAWN_SETSIGDEF);
+#endif /* POSIX_SPAWN_SETSID */
+  sigemptyset(&sigs);
+  posix_spawnattr_setsigmask(&spawnattr, &sigs);
+  sigfillset(&sigs);
+  posix_spawnattr_setsigdefault(&spawnattr, &sigs);
+}
+
+#ifdef IPC
+static void
+ipcaccept(int fd, __attribute__((unused)) short revents,
+          __attribute__((unused)) void *arg)
+{
+  IpcClient *ic;
+  int        cfd;
+
+  while ((cfd = accept(fd, NULL, NULL)) >= 0)
+  {
+    if (!ipcallowed(cfd))
+    {
+      fprintf(stderr, "rawm: ipc: connection of another user refused\n");
+      close(cfd);
+      continue;
+    }
+
+    fcntl(cfd, F_SETFD, FD_CLOEXEC);
+    fcntl(cfd, F_SETFL, fcntl(cfd, F_GETFL) | O_NONBLOCK);
+
+    if (!(ic = calloc(1, sizeof(IpcClient))))
+      die("fatal: could not malloc() %u bytes\n", sizeof(IpcClient));
+
+    ic->fd = cfd;
+
+    if (!addwatch(cfd, POLLIN, ipcinput, ic))
+    {
+      fprintf(stderr, "rawm: ipc: too many connections\n");
+      close(cfd);
+      free(ic);
+      continue;
+    }
+
+    ic->next   = ipcclients;
+    ipcclients = ic;
+  }
+}
+
+/* Returns true if the peer of the connection fd runs as the user, the
+ * mode of the socket is not honoured on every system. */
+static bool
+ipcallowed(int fd)
+{
+#ifdef SO_PEERCRED
+  struct ucred cred;
+  socklen_t    len = sizeof(cred);
+
+  return !getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len)
+         &&  cred.uid == getuid();
+#else
+  uid_t uid;
+  gid_t gid;
+
+  return !getpeereid(fd, &uid, &gid)  &&  uid == getuid();
+#endif /* SO_PEERCRED */
+}
+
+static void
+ipccleanup(void)
+{
+  while (ipcclients)
+    ipcdisconnect(ipcclients);
+
+  if (ipcfd >= 0)
+  {
+    delwatch(ipcfd);
+    close(ipcfd);
+    unlink(ipcpath);
+    ipcfd = -1;
+  }
+}
+
+static void
+ipcdisconnect(IpcClient *ic)
+{
+  IpcClient **icp;
+
+  for (icp = &ipcclients;  *icp && *icp != ic;  icp = &(*icp)->next)
+    /* NOTHING */;
+
+  if (*icp)
+    *icp = ic->next;
+
+  delwatch(ic->fd);
+  close(ic->fd);
+  free(ic->in.data);
+  free(ic->out.data);
+  free(ic);
+}
+
+/* Appends the state of all monitors, tags and clients to b. */
+static void
+ipcdump(Buffer *b)
+{
+  unsigned int  i, occ, urg;
+  Client       *c;
+  Monitor      *m;
+
+  for (i = 0;  i < LENGTH(layouts);  i++)
+    bufprintf(b, "layout %u %s\n", i, layouts[i].symbol);
+
+  for (m = mons;  m;  m = m->next)
+  {
+    bufprintf(b, "monitor %d selected=%d x=%d y=%d w=%d h=%d "
+                 "tags=%#x mfact=%.2f nmaster=%d bar=%d layout=%s\n",
+              m->num, m == selmon, m->mx, m->my, m->mw, m->mh,
+              m->tagset[m->seltags], m->mfact, m->nmaster,
+              m->showbar, m->ltsymbol);
+
+    for (occ = urg = 0, c = m->clients;  c;  c = c->next)
+    {
+      occ |= c->tags;
+      if (c->isurgent)
+        urg |= c->tags;
+    }
+
+    for (i = 0;  i < TAGS;  i++)
+      bufprintf(b, "tag %d %u selected=%d occupied=%d urgent=%d "
+                   "layout=%s name=%s\n",
+                m->num, i + 1,
+                !!(m->tagset[m->seltags] & 1 << i),
+                !!(occ & 1 << i), !!(urg & 1 << i),
+                m->pertag->ltidxs[i + 1][m->pertag->sellts[i + 1]]->symbol,
+                tags[m->num][i].tagname);
+
+    for (c = m->clients;  c;  c = c->next)
+      if (!c->pool)
+        bufprintf(b, "client %d %#lx tags=%#x x=%d y=%d w=%d h=%d "
+                     "focused=%d visible=%d floating=%d fullscreen=%d "
+                     "urgent=%d name=%s\n",
+                  m->num, c->win, c->tags, c->x, c->y, c->w, c->h,
+                  c == m->sel, !!ISVISIBLE(c), c->isfloating,
+                  c->isfullscreen, c->isurgent, c->name);
+  }
+
+  bufprintf(b, "bar requests=%lu renders=%lu blits=%lu\n",
+            barrequests, barrenders, barblits);
+}
+
+/* Queues the record "<ev> <monitor> <fmt>" for every subscriber of ev.
+ * A full queue drops the event and is followed by an "overflow <n>"
+ * record once there is space again. */
+static void
+ipcevent(int ev, Monitor *m, const char *fmt, ...)
+{
+  IpcClient *ic;
+  va_list    ap;
+  char       buf[512];
+  size_t     len;
+  int        n;
+
+  n = snprintf(buf, sizeof(buf), "%s %d ", ipcevents[ev], m->num);
+  len = n;
+
+  va_start(ap, fmt);
+  n = vsnprintf(buf + len, sizeof(buf) - len - 1, fmt, ap);
+  va_end(ap);
+
+  len = MIN(len + MAX(n, 0), sizeof(buf) - 2);
+  buf[len++] = '\n';
+
+  for (ic = ipcclients;  ic;  ic = ic->next)
+  {
+    if (!(ic->events & 1 << ev))
+      continue;
+
+    /* leave room for the overflow record */
+    if (ic->out.len + len + 32 > IPCMAXQUEUE)
+    {
+      ic->dropped++;
+      continue;
+    }
+
+    if (ic->dropped)
+    {
+      bufprintf(&ic->out, "overflow %u\n", ic->dropped);
+      ic->dropped = 0;
+    }
+
+    bufappend(&ic->out, buf, len);
+    setwatch(ic->fd, POLLIN | POLLOUT);
+  }
+}
+
+/* Reads requests from a connection, a request is a 32-bit payload
+ * length in host byte order followed by the NUL separated command
+ * and arguments. */
+static void
+ipcinput(int fd, short revents, void *arg)
+{
+  IpcClient *ic  = arg;
+  bool       eof = false;
+  char       buf[4096], *p, c;
+  ssize_t    n;
+  size_t     pos;
+  uint32_t   len;
+
+  if (revents & POLLOUT  &&  !ipcwrite(ic))
+    return;
+
+  if (revents & (POLLIN | POLLHUP | POLLERR))
+  {
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+      bufappend(&ic->in, buf, n);
+
+    eof = n == 0  ||  (errno != EAGAIN  &&  errno != EWOULDBLOCK
+                       &&  errno != EINTR);
+  }
+
+  for (pos = 0;
+       !ic->events  &&  ic->in.len - pos >= sizeof(len);
+       pos += sizeof(len) + len)
+  {
+    memcpy(&len, ic->in.data + pos, sizeof(len));
+
+    if (len > IPCMAXMSG)
+    {
+      fprintf(stderr, "rawm: ipc: request too large\n");
+      ipcdisconnect(ic);
+      return;
+    }
+
+    if (ic->in.len - pos - sizeof(len) < len)
+      break;
+
+    /* terminate the payload, keeping the byte of the next request */
+    bufappend(&ic->in, "", 1);
+    ic->in.len--;
+    p      = ic->in.data + pos + sizeof(len);
+    c      = p[len];
+    p[len] = '\0';
+    ipcrequest(ic, p, len);
+    p[len] = c;
+  }
+
+  /* subscribers only receive */
+  if (ic->events)
+    pos = ic->in.len;
+
+  ic->in.len -= pos;
+  memmove(ic->in.data, ic->in.data + pos, ic->in.len);
+
+  if (ipcwrite(ic)  &&  eof)
+    ipcdisconnect(ic);
 }
 
+/* Publishes the focus, tag and layout changes since the last call. */
+static void
+ipcpublish(void)
+{
+  Monitor *m;
+  Window   win = selmon->sel ? selmon->sel->win : None;
+
+  if (selmon->num != ipcfocusmon  ||  win != ipcfocuswin)
+  {
+    ipcfocusmon = selmon->num;
+    ipcfocuswin = win;
+    ipcevent(EvFocus, selmon, "%#lx", win);
+  }
+
+  for (m = mons;  m;  m = m->next)
+  {
+    if (m->tagset[m->seltags] != m->ipctagset)
+    {
+      m->ipctagset = m->tagset[m->seltags];
+      ipcevent(EvTag, m, "%#x", m->ipctagset);
+    }
+
+    if (m->lt[m->sellt] != m->ipclt)
+    {
+      m->ipclt = m->lt[m->sellt];
+      ipcevent(EvLayout, m, "%d %s", (int)(m->ipclt - layouts),
+               m->ipclt->symbol);
+    }
+  }
+}
+
+/* Executes the request msg of len bytes and queues the reply. */
+static void
+ipcrequest(IpcClient *ic, char *msg, size_t len)
+{
+  char         *argv[IPCMAXARGS + 1];
+  int           argc = 0;
+  size_t        i, off;
+  unsigned int  j, ev;
+  uint32_t      n;
+  Arg           arg;
+
+  for (i = 0;  i < len  &&  argc < IPCMAXARGS;  i += strlen(msg + i) + 1)
+    argv[argc++] = msg + i;
+  argv[argc] = NULL;
+
+  /* the reply is framed like a request, its length follows below */
+  off = ic->out.len;
+  bufappend(&ic->out, "\0\0\0\0", sizeof(n));
+
+  if (!argc)
+    bufprintf(&ic->out, "error: empty request\n");
+  else if (!strcmp(argv[0], "dump"))
+    ipcdump(&ic->out);
+  else if (!strcmp(argv[0], "subscribe"))
+  {
+    for (i = 1, ev = 0;  (int)i < argc;  i++)
+    {
+      for (j = 0;  j < EvLast  &&  strcmp(argv[i], ipcevents[j]);  j++)
+        /* NOTHING */;
+      ev |= 1 << j;
+    }
+
+    if (ev >= 1 << EvLast)
+      bufprintf(&ic->out, "error: unknown event\n");
+    else
+    {
+      /* events follow the reply */
+      ic->events = ev ? ev : (1 << EvLast) - 1;
+      bufprintf(&ic->out, "ok\n");
+    }
+  }
+  else
+  {
+    /* pointer commands need the button press of a binding */
+    for (i = 0;  i < LENGTH(commands);  i++)
+      if (   !strcmp(argv[0], commands[i].name)
+          &&  commands[i].argtype != ArgMouse
+          )
+        break;
+
+    if (i == LENGTH(commands))
+      bufprintf(&ic->out, "error: unknown command: %s\n", argv[0]);
+    else if (!parsearg(&commands[i], argv + 1, &arg))
+      bufprintf(&ic->out, "error: invalid argument: %s\n", argv[0]);
+    else
+    {
+      commands[i].func(&arg);
+      bufprintf(&ic->out, "ok\n");
+    }
+  }
+
+  n = ic->out.len - off - sizeof(n);
+  memcpy(ic->out.data + off, &n, sizeof(n));
+}
+
+/* Client mode: sends argv as a request to the running instance and
+ * prints its reply. */
+static int
+ipcsend(int argc, char *argv[])
+{
+  struct sockaddr_un  addr;
+  Buffer              b = {0};
+  char                buf[4096];
+  uint32_t            len;
+  ssize_t             n;
+  size_t              off;
+  int                 fd, i;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (!displaypath(addr.sun_path, sizeof(addr.sun_path), ipcsocket,
+                   "RAWM_SOCKET"))
+    die("rawm: ipc: socket path too long\n");
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+      ||  connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    die("rawm: ipc: cannot connect to %s: %s\n", addr.sun_path,
+        strerror(errno));
+
+  bufappend(&b, "\0\0\0\0", sizeof(len));
+  for (i = 0;  i < argc;  i++)
+    bufappend(&b, argv[i], strlen(argv[i]) + 1);
+  len = b.len - sizeof(len);
+  memcpy(b.data, &len, sizeof(len));
+
+  for (off = 0;  off < b.len;  off += n)
+    if ((n = send(fd, b.data + off, b.len - off, MSG_NOSIGNAL)) < 0)
+      die("rawm: ipc: send failed: %s\n", strerror(errno));
+
+  /* read the reply length, then the reply */
+  for (off = 0;  off < sizeof(len);  off += n)
+    if ((n = read(fd, (char *)&len + off, sizeof(len) - off)) <= 0)
+      die("rawm: ipc: no reply\n");
+
+  for (b.len = 0;  b.len < len;  bufappend(&b, buf, n))
+    if ((n = read(fd, buf, MIN(sizeof(buf), len - b.len))) <= 0)
+      die("rawm: ipc: short reply\n");
+
+  fwrite(b.data, 1, b.len, stdout);
+
+  /* a subscription is followed by event lines until rawm exits */
+  if (!strcmp(argv[0], "subscribe")  &&  !strncmp(b.data, "ok", 2))
+  {
+    fflush(stdout);
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+      fwrite(buf, 1, n, stdout);
+      fflush(stdout);
+    }
+  }
+
+  close(fd);
+
+  return b.len >= 5  &&  !strncmp(b.data, "error", 5)
+         ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* Creates the listening socket, IPC stays disabled on failure.  An
+ * existing path is only replaced if it is a socket of the user that
+ * nobody listens on any more, as left behind by a crash. */
+static void
+ipcsetup(void)
+{
+  struct sockaddr_un  addr;
+  struct stat         st;
+  const char         *err = NULL;
+  mode_t              mask;
+  int                 fd;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (!displaypath(addr.sun_path, sizeof(addr.sun_path), ipcsocket,
+                   "RAWM_SOCKET"))
+  {
+    fprintf(stderr, "rawm: ipc: socket path too long\n");
+    return;
+  }
+
+  if (lstat(addr.sun_path, &st) < 0)
+  {
+    if (errno != ENOENT)
+      err = strerror(errno);
+  }
+  else if (!S_ISSOCK(st.st_mode)  ||  st.st_uid != getuid())
+    err = "not a socket owned by the user";
+  else if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    err = strerror(errno);
+  else
+  {
+    if (!connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+      err = "in use by another rawm";
+    else if (errno == ECONNREFUSED)
+      unlink(addr.sun_path);
+    else if (errno != ENOENT)
+      err = strerror(errno);
+    close(fd);
+  }
+
+  if (err)
+  {
+    fprintf(stderr, "rawm: ipc: cannot use %s: %s\n", addr.sun_path, err);
+    return;
+  }
+
+  if ((ipcfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+  {
+    fprintf(stderr, "rawm: ipc: socket failed: %s\n", strerror(errno));
+    return;
+  }
+
+  fcntl(ipcfd, F_SETFD, FD_CLOEXEC);
+  fcntl(ipcfd, F_SETFL, fcntl(ipcfd, F_GETFL) | O_NONBLOCK);
+
+  /* only the user may connect */
+  mask = umask(0077);
+  if (bind(ipcfd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+      ||  listen(ipcfd, SOMAXCONN) < 0
+      ||  !addwatch(ipcfd, POLLIN, ipcaccept, NULL))
+  {
+    fprintf(stderr, "rawm: ipc: cannot listen on %s: %s\n",
+            addr.sun_path, strerror(errno));
+    close(ipcfd);
+    ipcfd = -1;
+  }
+  umask(mask);
+
+  if (ipcfd < 0)
+    return;
+
+  strcpy(ipcpath, addr.sun_path);
+  setenv("RAWM_SOCKET", ipcpath, 1);
+}
+
+/* Sends queued replies, returns false if the connection was closed. */
+static bool
+ipcwrite(IpcClient *ic)
+{
+  ssize_t n;
+
+  while (ic->out.len)
+  {
+    if ((n = send(ic->fd, ic->out.data, ic->out.len, MSG_NOSIGNAL)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN  ||  errno == EWOULDBLOCK)
+        break;
+
+      ipcdisconnect(ic);
+      return false;
+    }
+
+    ic->out.len -= n;
+    memmove(ic->out.data, ic->out.data + n, ic->out.len);
+  }
+
+  setwatch(ic->fd, ic->out.len ? POLLIN | POLLOUT : POLLIN);
+
+  return true;
+}
+#endif /* IPC */
+
 #ifdef XINERAMA
 static bool
 isuniquegeom(XineramaScreenInfo *unique, size_t n,
@@ -2269,19 +3998,21 @@ keypress(XEvent *e)
   ev     = &e->xkey;
   keysym = XKeycodeToKeysym(dpy, (KeyCode)ev->keycode, 0);
 
-  for (i = 0; i < LENGTH(keys); i++)
+  for (i = 0; i < cfg.nkeys; i++)
   {
-    if (   (keysym == keys[i].keysym)
-        && (CLEANMASK(keys[i].mod) == CLEANMASK(ev->state))
-        &&  keys[i].func
+    if (   (keysym == cfg.keys[i].keysym)
+        && (CLEANMASK(cfg.keys[i].mod) == CLEANMASK(ev->state))
+        &&  cfg.keys[i].func
         )
-      keys[i].func( &(keys[i].arg) );
+      cfg.keys[i].func( &(cfg.keys[i].arg) );
   }
 }
 
 static void
 killclient(__attribute__((unused)) const Arg *arg)
 {
+  unsigned long seq;
+
   if (!selmon->sel)
     return;
 #ifdef SYSTRAY
@@ -2294,14 +4025,552 @@ killclient(__attribute__((unused)) const Arg *arg)
   if (!sendevent(selmon->sel,      wmatom[WMDelete]))
 #endif /* SYSTRAY */
   {
-    XGrabServer(dpy);
-    XSetErrorHandler(xerrordummy);
-    XSetCloseDownMode(dpy, DestroyAll);
-    XKillClient(dpy, selmon->sel->win);
-    XSync(dpy, false);
-    XSetErrorHandler(xerror);
-    XUngrabServer(dpy);
+    seq = ignorebegin();
+    XSetCloseDownMode(dpy, DestroyAll);
+    XKillClient(dpy, selmon->sel->win);
+    ignoreend(seq);
+  }
+}
+
+/* Starts argv[0] as spawnchild() does, through the launcher if there
+ * is one.  The launcher reaps its children itself, so 0 is returned
+ * instead of their pid. */
+static pid_t
+launch(char *const argv[], int outfd)
+{
+#ifdef LAUNCHER
+  if (launcherrequest(argv, outfd))
+    return 0;
+#endif /* LAUNCHER */
+
+  return spawnchild(argv, outfd);
+}
+
+#ifdef LAUNCHER
+/* Runs in the launcher: starts the children requested by rawm
+ * through fd until rawm exits or restarts.  A request is the number
+ * of arguments as a uint32_t, the arguments and then the environment,
+ * each string ending with a NUL byte.  The descriptor to use as
+ * stdout may be passed along. */
+static void
+launcherloop(int fd)
+{
+  static char                buf[LAUNCHERMAXMSG];
+  union {
+    struct cmsghdr hdr;
+    char           buf[CMSG_SPACE(sizeof(int))];
+  }                          cbuf;
+  struct iovec               iov = { buf, sizeof(buf) };
+  struct msghdr              msg;
+  struct cmsghdr            *cmsg;
+  posix_spawn_file_actions_t fa;
+  char                     **strs, *p;
+  uint32_t                   argc;
+  ssize_t                    n;
+  size_t                     i, nstrs;
+  pid_t                      pid;
+  int                        outfd, err;
+
+  /* children are reaped by the kernel, they get back the default
+   * disposition from spawnattr */
+  signal(SIGCHLD, SIG_IGN);
+
+  for (;;)
+  {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = cbuf.buf;
+    msg.msg_controllen = sizeof(cbuf.buf);
+
+    if ((n = recvmsg(fd, &msg, 0)) < 0  &&  errno == EINTR)
+      continue;
+    if (n <= 0)
+      _exit(EXIT_SUCCESS);
+
+    outfd = -1;
+    for (cmsg = CMSG_FIRSTHDR(&msg);  cmsg;  cmsg = CMSG_NXTHDR(&msg, cmsg))
+      if (   cmsg->cmsg_level == SOL_SOCKET
+          && cmsg->cmsg_type  == SCM_RIGHTS)
+        memcpy(&outfd, CMSG_DATA(cmsg), sizeof(int));
+
+    nstrs = 0;
+    for (i = sizeof(argc);  i < (size_t)n;  i++)
+      nstrs += !buf[i];
+
+    memcpy(&argc, buf, sizeof(argc));
+    if (   (size_t)n <= sizeof(argc)  ||  buf[n - 1]
+        || !argc  ||  argc > nstrs  ||  (msg.msg_flags & MSG_TRUNC)
+        || !(strs = calloc(nstrs + 2, sizeof(char *))))
+    {
+      if (outfd >= 0)
+        close(outfd);
+      continue;
+    }
+
+    /* arguments, NULL, environment, NULL */
+    for (i = 0, p = buf + sizeof(argc);  p < buf + n;  p += strlen(p) + 1)
+    {
+      if (i == argc)
+        i++;
+      strs[i++] = p;
+    }
+
+    if (outfd >= 0)
+    {
+      posix_spawn_file_actions_init(&fa);
+      posix_spawn_file_actions_adddup2(&fa, outfd, STDOUT_FILENO);
+      if (outfd != STDOUT_FILENO)
+        posix_spawn_file_actions_addclose(&fa, outfd);
+    }
+
+    if ((err = posix_spawnp(&pid, strs[0], outfd >= 0 ? &fa : NULL,
+                            &spawnattr, strs, strs + argc + 1)))
+      fprintf(stderr, "rawm: cannot run %s: %s\n", strs[0],
+              strerror(err));
+
+    if (outfd >= 0)
+    {
+      posix_spawn_file_actions_destroy(&fa);
+      close(outfd);
+    }
+
+    free(strs);
+  }
+}
+
+/* Passes a launch() request to the launcher, returns false if it has
+ * to be handled by rawm itself. */
+static bool
+launcherrequest(char *const argv[], int outfd)
+{
+  extern char  **environ;
+  static char    buf[LAUNCHERMAXMSG];
+  union {
+    struct cmsghdr hdr;
+    char           buf[CMSG_SPACE(sizeof(int))];
+  }              cbuf;
+  struct iovec   iov = { buf, 0 };
+  struct msghdr  msg;
+  struct cmsghdr *cmsg;
+  char *const   *s;
+  uint32_t       argc = 0;
+  size_t         len;
+  int            pass;
+
+  if (launcherfd < 0)
+    return false;
+
+  iov.iov_len = sizeof(argc);
+
+  for (pass = 0;  pass < 2;  pass++)
+  {
+    for (s = pass ? environ : argv;  *s;  s++)
+    {
+      if ((len = strlen(*s) + 1) > sizeof(buf) - iov.iov_len)
+        return false;
+
+      memcpy(buf + iov.iov_len, *s, len);
+      iov.iov_len += len;
+      argc        += !pass;
+    }
+  }
+
+  memcpy(buf, &argc, sizeof(argc));
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov    = &iov;
+  msg.msg_iovlen = 1;
+
+  if (outfd >= 0)
+  {
+    msg.msg_control    = cbuf.buf;
+    msg.msg_controllen = sizeof(cbuf.buf);
+    cmsg               = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level   = SOL_SOCKET;
+    cmsg->cmsg_type    = SCM_RIGHTS;
+    cmsg->cmsg_len     = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &outfd, sizeof(int));
+  }
+
+  /* never wait for a busy launcher */
+  if (sendmsg(launcherfd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL) >= 0)
+    return true;
+
+  if (errno != EAGAIN  &&  errno != EWOULDBLOCK  &&  errno != EMSGSIZE)
+  {
+    fprintf(stderr, "rawm: launcher: %s\n", strerror(errno));
+    close(launcherfd);
+    launcherfd = -1;
+  }
+
+  return false;
+}
+
+/* Forks the launcher while rawm is still small, before the display,
+ * the fonts and the threads exist. */
+static void
+launcherstart(void)
+{
+  int fds[2];
+
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0)
+  {
+    fprintf(stderr, "rawm: launcher: socketpair failed: %s\n",
+            strerror(errno));
+    return;
+  }
+
+  switch (fork())
+  {
+    case -1:
+      fprintf(stderr, "rawm: launcher: fork failed: %s\n",
+              strerror(errno));
+      close(fds[0]);
+      break;
+
+    case 0:
+      close(fds[0]);
+      launcherloop(fds[1]);
+      break;
+
+    default:
+      launcherfd = fds[0];
+      fcntl(launcherfd, F_SETFD, FD_CLOEXEC);
+      break;
+  }
+
+  close(fds[1]);
+}
+#endif /* LAUNCHER */
+
+/* Builds c from the tables of config.h and the runtime configuration
+ * file, and applies its colors and tags.  Returns the number of
+ * invalid lines, which are reported and skipped. */
+static int
+loadconfig(Config *c)
+{
+  FILE          *f;
+  Monitor       *m;
+  const Command *cmd = NULL;
+  const char    *dir, *sub;
+  char           path[PATH_MAX], line[1024], *argv[CFGMAXARGS + 1], **v;
+  int            argc, lineno = 0, errors = 0, i, j, num;
+  unsigned int   mods, n, click = ClkLast;
+  bool           hasrules = false, haskeys = false, hasbuttons = false, ok;
+  KeySym         sym = NoSymbol;
+  XColor         xc;
+  Arg            arg;
+
+  /* start from the compiled-in tables */
+  memset(c, 0, sizeof(Config));
+  for (n = 0;  n < LENGTH(rules);  n++)
+    (c->rules = growarray(c->rules, n, sizeof(Rule)))[c->nrules++] = rules[n];
+  for (n = 0;  n < LENGTH(keys);  n++)
+  {
+    c->keys = growarray(c->keys, n, sizeof(Key));
+    memcpy(&c->keys[c->nkeys++], &keys[n], sizeof(Key));
+  }
+  for (n = 0;  n < LENGTH(buttons);  n++)
+  {
+    c->buttons = growarray(c->buttons, n, sizeof(Button));
+    memcpy(&c->buttons[c->nbuttons++], &buttons[n], sizeof(Button));
+  }
+  for (n = 0;  n < NUMCOLORS * ColLast;  n++)
+    strcpy(colornames[n / ColLast][n % ColLast],
+           colors[n / ColLast][n % ColLast]);
+
+  if ((dir = getenv("RAWM_CONFIG"))  &&  *dir)
+    snprintf(path, sizeof(path), "%s", dir);
+  else
+  {
+    sub = "rawm/config";
+    if (!(dir = getenv("XDG_CONFIG_HOME"))  ||  !*dir)
+    {
+      dir = getenv("HOME") ? getenv("HOME") : "";
+      sub = ".config/rawm/config";
+    }
+    snprintf(path, sizeof(path), "%s/%s", dir, sub);
+  }
+
+  if (!(f = fopen(path, "r")))
+  {
+    if (errno != ENOENT)
+    {
+      fprintf(stderr, "rawm: cannot open %s: %s\n", path, strerror(errno));
+      errors++;
+    }
+    return errors;
+  }
+
+  while (fgets(line, sizeof(line), f))
+  {
+    lineno++;
+
+    if (!(argc = tokenize(line, argv, CFGMAXARGS)))
+      continue;
+    argv[argc] = NULL;
+
+    /* the command of a binding and its arguments */
+    j = !strcmp(argv[0], "key") ? 3 : !strcmp(argv[0], "button") ? 4 : 0;
+    if (j  &&  argc > j)
+    {
+      for (n = 0;  n < LENGTH(commands);  n++)
+        if (!strcmp(argv[j], commands[n].name))
+          break;
+      cmd = n < LENGTH(commands) ? &commands[n] : NULL;
+    }
+
+    if (!strcmp(argv[0], "color"))
+    {
+      n  = argc == 5 ? strtoul(argv[1], NULL, 10) : NUMCOLORS;
+      ok = n < NUMCOLORS;
+
+      for (i = 0;  ok  &&  i < ColLast;  i++)
+        ok = strlen(argv[i + 2]) < sizeof(colornames[0][0])
+          && XParseColor(dpy, DefaultColormap(dpy, screen), argv[i + 2], &xc);
+
+      for (i = 0;  ok  &&  i < ColLast;  i++)
+        strcpy(colornames[n][i], argv[i + 2]);
+    }
+    else if (!strcmp(argv[0], "rule"))
+    {
+      if ((ok = argc == 9))
+      {
+        if (!hasrules)
+          c->nrules = 0;
+        hasrules = true;
+
+        c->rules = growarray(c->rules, c->nrules, sizeof(Rule));
+        for (i = 1;  i <= 4;  i++)
+          argv[i] = strcmp(argv[i], "-") ? configstr(c, argv[i]) : NULL;
+
+        c->rules[c->nrules++] = (Rule){
+          .class      = argv[1],
+          .instance   = argv[2],
+          .title      = argv[3],
+          .role       = argv[4],
+          .tags       = strtoul(argv[5], NULL, 0),
+          .isfloating = atoi(argv[6]),
+          .iscentered = atoi(argv[7]),
+          .monitor    = atoi(argv[8]),
+        };
+      }
+    }
+    else if (!strcmp(argv[0], "key"))
+    {
+      if ((ok = argc >= 4  &&  cmd  &&  parsemods(argv[1], &mods)
+                &&  (sym = XStringToKeysym(argv[2])) != NoSymbol
+                &&  parsearg(cmd, argv + 4, &arg)))
+      {
+        if (!haskeys)
+          c->nkeys = 0;
+        haskeys = true;
+      }
+    }
+    else if (!strcmp(argv[0], "button"))
+    {
+      for (click = 0;
+           click < ClkLast  &&  (!clicks[click] || strcmp(argv[1], clicks[click]));
+           click++)
+        /* NOTHING */;
+      num = argc >= 5 ? atoi(argv[3]) : 0;
+
+      if ((ok = argc >= 5  &&  cmd  &&  click < ClkLast
+                &&  parsemods(argv[2], &mods)  &&  num >= 1  &&  num <= 5
+                &&  parsearg(cmd, argv + 5, &arg)))
+      {
+        if (!hasbuttons)
+          c->nbuttons = 0;
+        hasbuttons = true;
+      }
+    }
+    else if (!strcmp(argv[0], "tag"))
+    {
+      num = argc >= 4 ? atoi(argv[1]) : -1;
+      i   = argc >= 4 ? atoi(argv[2]) : 0;
+
+      if ((ok = (argc == 4 || argc == 5)
+                &&  num >= 0  &&  num < (int)LENGTH(tags)
+                &&  i >= 1  &&  i <= TAGS
+                &&  strlen(argv[3]) < MAX_TAGLEN
+                &&  parsearg(&(Command){ "tag", NULL, ArgLayout },
+                             argv + 4, &arg)))
+      {
+        i--;
+        strcpy(tags[num][i].tagname, argv[3]);
+
+        /* a changed default layout applies to the tag right away */
+        j = arg.v ? (const Layout *)arg.v - layouts : tags[num][i].layout_idx;
+        if (j != tags[num][i].layout_idx)
+        {
+          tags[num][i].layout_idx = j;
+
+          for (m = mons;  m;  m = m->next)
+          {
+            if (m->num != num)
+              continue;
+
+            m->pertag->ltidxs[i + 1][m->pertag->sellts[i + 1]] = arg.v;
+            if (m->pertag->curtag == (unsigned int)i + 1)
+              m->lt[m->sellt] = arg.v;
+          }
+        }
+      }
+    }
+    else
+      ok = false;
+
+    if (!ok)
+    {
+      fprintf(stderr, "rawm: %s:%d: invalid line\n", path, lineno);
+      errors++;
+      continue;
+    }
+
+    if (!strcmp(argv[0], "key")  ||  !strcmp(argv[0], "button"))
+    {
+      /* the command line must outlive this buffer */
+      if (cmd->argtype == ArgCmd)
+      {
+        for (n = 0;  ((char **)arg.v)[n];  n++)
+          /* NOTHING */;
+
+        if (!(v = calloc(n + 1, sizeof(char *))))
+          die("fatal: could not malloc() %u bytes\n", (n + 1) * sizeof(char *));
+        c->mem = growarray(c->mem, c->nmem, sizeof(void *));
+        c->mem[c->nmem++] = v;
+
+        for (n = 0;  ((char **)arg.v)[n];  n++)
+          v[n] = configstr(c, ((char **)arg.v)[n]);
+        arg.v = v;
+      }
+
+      if (!strcmp(argv[0], "key"))
+      {
+        Key k = { mods, sym, cmd->func, arg };
+
+        c->keys = growarray(c->keys, c->nkeys, sizeof(Key));
+        memcpy(&c->keys[c->nkeys++], &k, sizeof(Key));
+      }
+      else
+      {
+        Button b = { click, mods, num, cmd->func, arg };
+
+        c->buttons = growarray(c->buttons, c->nbuttons, sizeof(Button));
+        memcpy(&c->buttons[c->nbuttons++], &b, sizeof(Button));
+      }
+    }
+  }
+
+  fclose(f);
+
+  return errors;
+}
+
+/* Reads the state saved by savestate() before a restart, applies the
+ * monitor state and keeps the clients for restoreclient(). */
+static void
+loadstate(void)
+{
+  FILE         *f;
+  Monitor      *m;
+  SavedClient   sc;
+  Window        sel = None;
+  char         *env, line[512], *p;
+  int           num, i, n, lt[2], nm, bar, fl, sl;
+  unsigned int  st, ts[2], cur, prev, kg;
+  float         mf;
+
+  if (!(env = getenv("RAWM_STATE")))
+    return;
+
+  f = fdopen(atoi(env), "r");
+  unsetenv("RAWM_STATE");
+
+  if (!f)
+    return;
+
+  while (fgets(line, sizeof(line), f))
+  {
+    if ((p = strchr(line, '\n')))
+      *p = '\0';
+
+    m          = NULL;
+    sc.pool    = 0;
+    sc.scratch = 0;
+    if (sscanf(line, "%*s %d", &num) == 1)
+      for (m = mons;  m && m->num != num;  m = m->next)
+        /* NOTHING */;
+
+    if (!strncmp(line, "selmon ", 7))
+    {
+      if (m)
+        selmon = m;
+    }
+    else if (sscanf(line, "monitor %d %u %d %u %u %d %d %f %d %d %u %u %lx",
+                    &num, &st, &sl, &ts[0], &ts[1], &lt[0], &lt[1], &mf,
+                    &nm, &bar, &cur, &prev, &sel) == 13  &&  m
+             &&  lt[0] >= 0  &&  lt[0] < (int)LENGTH(layouts)
+             &&  lt[1] >= 0  &&  lt[1] < (int)LENGTH(layouts)
+             &&  cur <= TAGS  &&  prev <= TAGS)
+    {
+      m->seltags         = st & 1;
+      m->sellt           = sl & 1;
+      m->tagset[0]       = ts[0] & TAGMASK;
+      m->tagset[1]       = ts[1] & TAGMASK;
+      m->lt[0]           = &layouts[lt[0]];
+      m->lt[1]           = &layouts[lt[1]];
+      m->mfact           = mf;
+      m->nmaster         = nm;
+      m->showbar         = bar;
+      m->pertag->curtag  = cur;
+      m->pertag->prevtag = prev;
+      updatebarpos(m);
+    }
+    else if (sscanf(line, "pertag %d %d %d %f %d %d %d %d",
+                    &num, &i, &nm, &mf, &sl, &lt[0], &lt[1], &bar) == 8
+             &&  m  &&  i >= 0  &&  i <= TAGS
+             &&  lt[0] >= 0  &&  lt[0] < (int)LENGTH(layouts)
+             &&  lt[1] >= 0  &&  lt[1] < (int)LENGTH(layouts))
+    {
+      m->pertag->nmasters[i]  = nm;
+      m->pertag->mfacts[i]    = mf;
+      m->pertag->sellts[i]    = sl & 1;
+      m->pertag->ltidxs[i][0] = &layouts[lt[0]];
+      m->pertag->ltidxs[i][1] = &layouts[lt[1]];
+      m->pertag->showbars[i]  = bar;
+    }
+    else if (sscanf(line, "tagname %d %d %n", &num, &i, &n) == 2
+             &&  m  &&  i >= 0  &&  i < TAGS)
+      snprintf(tags[num][i].tagname, MAX_TAGLEN, "%s", line + n);
+    else if (sscanf(line, "client %lx %d %u %d %d %d %d %d %d %u %u %u",
+                    &sc.win, &sc.mon, &sc.tags, &fl, &sc.x, &sc.y, &sc.w,
+                    &sc.h, &sc.oldbw, &kg, &sc.pool, &sc.scratch) >= 10)
+    {
+      if (!(nsaved % 16)
+          &&  !(saved = realloc(saved, (nsaved + 16) * sizeof(SavedClient))))
+        die("fatal: could not realloc() %u bytes\n",
+            (nsaved + 16) * sizeof(SavedClient));
+
+      sc.isfloating   = fl;
+      sc.issel        = sc.win == sel;
+      sc.kbdgrp       = kg;
+      saved[nsaved++] = sc;
+    }
+    else if (sscanf(line, "stack %lx", &sc.win) == 1)
+    {
+      if (!(nsavedstack % 16)
+          &&  !(savedstack = realloc(savedstack,
+                                     (nsavedstack + 16) * sizeof(Window))))
+        die("fatal: could not realloc() %u bytes\n",
+            (nsavedstack + 16) * sizeof(Window));
+
+      savedstack[nsavedstack++] = sc.win;
+    }
   }
+
+  fclose(f);
 }
 
 static void
@@ -2310,9 +4579,7 @@ manage(Window w, XWindowAttributes *wa)
   Client         *c, *t = NULL;
   Window          trans = None;
   XWindowChanges  wc;
-#ifdef PWKL
-  XkbStateRec     kbd_state;
-#endif /* PWKL */
+  SavedClient    *s = getsaved(w);
 
   if (!(c = calloc(1, sizeof(Client))))
     die("fatal: could not malloc() %u bytes\n", sizeof(Client));
@@ -2324,7 +4591,7 @@ manage(Window w, XWindowAttributes *wa)
   {
     XChangeProperty(dpy,
                     c->win,
-                    XInternAtom(dpy, "_NET_WM_WINDOW_OPACITY", false),
+                    netatom[NetWMWindowOpacity],
                     XA_CARDINAL,
                     32,
                     PropModeReplace,
@@ -2343,7 +4610,23 @@ manage(Window w, XWindowAttributes *wa)
   else
   {
     c->mon = selmon;
-    applyrules(c);
+    if (!s)
+      applyrules(c);
+  }
+
+  /* a pooled command is kept hidden on no tag until spawned, a
+   * scratchpad floats centred on the selected monitor */
+  if (!s  &&  pendingmatch(c))
+  {
+    if (c->pool)
+      c->tags = 0;
+    else
+    {
+      c->mon        = selmon;
+      c->tags       = selmon->tagset[selmon->seltags];
+      c->isfloating = c->oldstate = true;
+      c->iscentered = true;
+    }
   }
 
   /* geometry */
@@ -2372,17 +4655,25 @@ manage(Window w, XWindowAttributes *wa)
 
   c->bw = borderpx;
 
+  if (s)
+    restoreclient(c, s);
+
   wc.border_width = c->bw;
 
   XConfigureWindow(dpy, w, CWBorderWidth, &wc);
   XSetWindowBorder(dpy, w, dc.colors[0][ColBorder].pixel);
 
   configure(c); /* propagates border_width, if size doesn't change */
+  c->winstate = getatomprop(c, netatom[NetWMState]);
+  c->wintype  = getatomprop(c, netatom[NetWMWindowType]);
   updatewindowtype(c);
   updatesizehints(c);
   updatewmhints(c);
+  updateprotocols(c);
 
-  if (c->iscentered  ||  (c->mon->lt[c->mon->sellt]->arrange == NULL))
+  if (   !s
+      && (c->iscentered  ||  (c->mon->lt[c->mon->sellt]->arrange == NULL))
+      )
   {
     c->x = c->mon->mx + (c->mon->mw - WIDTH(c))  / 2;
     c->y = c->mon->my + (c->mon->mh - HEIGHT(c)) / 2;
@@ -2397,7 +4688,7 @@ manage(Window w, XWindowAttributes *wa)
                );
   grabbuttons(c, false);
 
-  if (!c->isfloating)
+  if (!s  &&  !c->isfloating)
     c->isfloating = c->oldstate =
       ((trans != None) || c->isfixed);
 
@@ -2406,34 +4697,47 @@ manage(Window w, XWindowAttributes *wa)
 
   attach(c);
   attachstack(c);
+#ifdef IPC
+  if (!c->pool)
+    ipcevent(EvMap, c->mon, "%#lx", c->win);
+#endif /* IPC */
 
   /* some windows require this */
   XMoveResizeWindow(dpy, c->win, c->x + 2 * sw, c->y, c->w, c->h);
 
   setclientstate(c, NormalState);
 
-  XChangeProperty(dpy,
-                  root,
-                  netatom[NetClientList],
-                  XA_WINDOW,
-                  32,
-                  PropModeAppend,
-                  (unsigned char *) &(c->win),
-                  1
-                  );
+  /* hidden pooled windows are published once spawned */
+  if (!c->pool)
+    XChangeProperty(dpy,
+                    root,
+                    netatom[NetClientList],
+                    XA_WINDOW,
+                    32,
+                    PropModeAppend,
+                    (unsigned char *) &(c->win),
+                    1
+                    );
 
-  if (c->mon == selmon)
-    unfocus(selmon->sel, false);
+  if (!c->pool)
+  {
+    if (c->mon == selmon)
+      unfocus(selmon->sel, false);
 
-  c->mon->sel = c;
+    c->mon->sel = c;
+  }
 
 #ifdef PWKL
-  XkbGetState(dpy, XkbUseCoreKbd, &kbd_state);
-  c->kbdgrp = kbd_state.group;
+  if (!s)
+    c->kbdgrp = kbdgrp;
 #endif /* PWKL */
-  arrange(c->mon);
+
+  /* scan() arranges once all windows are managed */
+  if (!scanning)
+    arrange(c->mon);
   XMapWindow(dpy, c->win);
-  focus(NULL);
+  if (!scanning)
+    focus(NULL);
 }
 
 static void
@@ -2442,8 +4746,11 @@ mappingnotify(XEvent *e)
   XMappingEvent *ev = &e->xmapping;
 
   XRefreshKeyboardMapping(ev);
-  if (ev->request == MappingKeyboard)
+  if (ev->request == MappingModifier  ||  ev->request == MappingKeyboard)
+  {
+    updatenumlockmask();
     grabkeys();
+  }
 }
 
 static void
@@ -2465,7 +4772,6 @@ maprequest(XEvent *e)
               systray->win,
               XEMBED_EMBEDDED_VERSION
               );
-    resizebarwin(selmon);
     updatesystray();
   }
 #endif /* SYSTRAY */
@@ -2480,6 +4786,182 @@ maprequest(XEvent *e)
     manage(ev->window, &wa);
 }
 
+/* Shows the charge of the power supply arg, followed by + while
+ * charging and - while discharging. */
+static void
+modbattery(char *buf, size_t size, const char *arg)
+{
+  char path[PATH_MAX], cap[16], st[32];
+
+  *buf = '\0';
+
+  snprintf(path, sizeof(path), "/sys/class/power_supply/%s/capacity", arg);
+  if (readfile(path, cap, sizeof(cap)) <= 0)
+    return;
+
+  snprintf(path, sizeof(path), "/sys/class/power_supply/%s/status", arg);
+  if (readfile(path, st, sizeof(st)) < 0)
+    *st = '\0';
+
+  snprintf(buf, size, "%s %d%%%s", arg, atoi(cap),
+           !strncmp(st, "Charging",    8) ? "+" :
+           !strncmp(st, "Discharging", 11) ? "-" : "");
+}
+
+/* Shows the CPU usage since the previous call, from /proc/stat. */
+static void
+modcpu(char *buf, size_t size, const char *arg)
+{
+  static unsigned long long ptotal = 0, pidle = 0;
+  unsigned long long        v[8] = { 0 }, total, idle;
+  char                      stat[512];
+  int                       i;
+
+  *buf = '\0';
+
+  if (   readfile("/proc/stat", stat, sizeof(stat)) <= 0
+      || sscanf(stat, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+                &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+                &v[7]) < 4)
+    return;
+
+  for (i = 0, total = 0;  i < 8;  i++)
+    total += v[i];
+  idle = v[3] + v[4];
+
+  snprintf(buf, size, "%s %llu%%", arg,
+           total > ptotal
+           ? 100 * ((total - ptotal) - (idle - pidle)) / (total - ptotal)
+           : 0);
+
+  ptotal = total;
+  pidle  = idle;
+}
+
+/* Shows the local time formatted by strftime(3) with arg. */
+static void
+moddate(char *buf, size_t size, const char *arg)
+{
+  time_t    t = time(NULL);
+  struct tm tm;
+
+  if (!localtime_r(&t, &tm)  ||  !strftime(buf, size, arg, &tm))
+    *buf = '\0';
+}
+
+/* Shows the load average of the last minute. */
+static void
+modload(char *buf, size_t size, const char *arg)
+{
+  double avg;
+
+  if (getloadavg(&avg, 1) < 1)
+    *buf = '\0';
+  else
+    snprintf(buf, size, "%s %.2f", arg, avg);
+}
+
+/* Shows the share of memory in use, from /proc/meminfo. */
+static void
+modmem(char *buf, size_t size, const char *arg)
+{
+  char               info[2048], *p, *q;
+  unsigned long long total, avail;
+
+  *buf = '\0';
+
+  if (   readfile("/proc/meminfo", info, sizeof(info)) <= 0
+      || !(p = strstr(info, "MemTotal:"))
+      || !(q = strstr(info, "MemAvailable:"))
+      || !(total = strtoull(p + 9, NULL, 10)))
+    return;
+
+  avail = strtoull(q + 13, NULL, 10);
+  snprintf(buf, size, "%s %llu%%", arg,
+           avail < total ? 100 * (total - avail) / total : 0);
+}
+
+/* Shows the receive and transmit rates of interface arg since the
+ * previous call, from /proc/net/dev. */
+static void
+modnet(char *buf, size_t size, const char *arg)
+{
+  static unsigned long long  prx = 0, ptx = 0;
+  static long long           pwhen = 0;
+  static const char          units[] = "BKMGT";
+  unsigned long long         rx, tx, rate[2];
+  long long                  now = clockms();
+  char                       dev[8192], name[64], *p;
+  int                        i, u[2];
+
+  *buf = '\0';
+
+  snprintf(name, sizeof(name), "%s:", arg);
+  if (   readfile("/proc/net/dev", dev, sizeof(dev)) <= 0
+      || !(p = strstr(dev, name))
+      || sscanf(p + strlen(name),
+                "%llu %*u %*u %*u %*u %*u %*u %*u %llu", &rx, &tx) != 2)
+    return;
+
+  rate[0] = pwhen  &&  now > pwhen  &&  rx >= prx
+          ? (rx - prx) * 1000 / (now - pwhen) : 0;
+  rate[1] = pwhen  &&  now > pwhen  &&  tx >= ptx
+          ? (tx - ptx) * 1000 / (now - pwhen) : 0;
+
+  for (i = 0;  i < 2;  i++)
+    for (u[i] = 0;  rate[i] >= 1024  &&  units[u[i] + 1];  u[i]++)
+      rate[i] /= 1024;
+
+  snprintf(buf, size, "%s %llu%c/%llu%c", arg,
+           rate[0], units[u[0]], rate[1], units[u[1]]);
+
+  prx   = rx;
+  ptx   = tx;
+  pwhen = now;
+}
+
+/* Runs the module arg and updates its status block. */
+static void
+modrun(void *arg)
+{
+  const Module *mod = arg;
+  char          buf[256];
+
+  modfunc[mod - modules](buf, sizeof(buf), mod->arg);
+  setblock(mod->block, buf);
+}
+
+/* Runs the modules once and starts the timers of those having an
+ * interval.  The first expiry is aligned to a multiple of the
+ * interval, so that modules with related intervals share wakeups. */
+static void
+modsetup(void)
+{
+  unsigned int i, j, iv;
+
+  for (i = 0;  i < LENGTH(modules);  i++)
+  {
+    if (!modules[i].block)
+      continue;
+
+    for (j = 0;
+         j < LENGTH(modfuncs)  &&  strcmp(modules[i].name, modfuncs[j].name);
+         j++)
+      /* NOTHING */;
+
+    if (j == LENGTH(modfuncs))
+    {
+      fprintf(stderr, "rawm: unknown status module: %s\n", modules[i].name);
+      continue;
+    }
+
+    modfunc[i] = modfuncs[j].func;
+    modrun((void *)&modules[i]);
+    if ((iv = modules[i].interval))
+      addtimer(iv - clockms() % iv, iv, modrun, (void *)&modules[i]);
+  }
+}
+
 static void
 monocle(Monitor *m)
 {
@@ -2611,87 +5093,402 @@ movemouse(__attribute__((unused)) const Arg *arg)
     }
   } while (ev.type != ButtonRelease);
 
-  XUngrabPointer(dpy, CurrentTime);
+  XUngrabPointer(dpy, CurrentTime);
+
+  if ((m = recttomon(c->x, c->y, c->w, c->h))  !=  selmon)
+  {
+    sendmon(c, m);
+    selmon = m;
+    focus(NULL);
+  }
+}
+
+/* Opens dmenu to name the selected tags. The answer is read by
+ * readprompt() from the main loop, so rawm keeps handling events
+ * while the prompt is open. */
+static void
+nametag(__attribute__((unused)) const Arg *arg)
+{
+  char  buf[256];
+  char *argv[] = { "/bin/sh", "-c", buf, NULL };
+  int   fds[2], i;
+  pid_t pid;
+
+  if (prompt.fd >= 0)
+    return;
+
+  snprintf(buf, sizeof(buf),
+    "dmenu -p '%s' -fn '%s' -nb '%s' -nf '%s' -sb '%s' -sf '%s' "
+    "</dev/null", "Current tag name: ",
+    font,
+    colornames[0][ColBG],
+    colornames[0][ColFG],
+    colornames[1][ColBG],
+    colornames[1][ColFG]);
+
+  if (pipe(fds) < 0)
+  {
+    fprintf(stderr, "rawm: nametag: pipe failed: %s\n",
+            strerror(errno));
+    return;
+  }
+
+  for (i = 0;  i < 2;  i++)
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+
+  pid = launch(argv, fds[1]);
+  close(fds[1]);
+
+  if (pid < 0  ||  !addwatch(fds[0], POLLIN, readprompt, NULL))
+  {
+    close(fds[0]);
+    return;
+  }
+
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+  prompt.fd   = fds[0];
+  prompt.len  = 0;
+  prompt.mon  = selmon->num;
+  prompt.tags = selmon->tagset[selmon->seltags];
+}
+
+static Client *
+nexttiled(Client *c)
+{
+  for ( ;  c && (c->isfloating || !ISVISIBLE(c));  c = c->next)
+    /* NOTHING */;
+
+  return c;
+}
+
+/* Converts the arguments of cmd to arg, returns false if they are
+ * invalid. */
+static bool
+parsearg(const Command *cmd, char *argv[], Arg *arg)
+{
+  char          *end;
+  unsigned long  n;
+
+  memset(arg, 0, sizeof(Arg));
+
+  if (cmd->argtype == ArgCmd)
+  {
+    arg->v = argv;
+    return argv[0] != NULL;
+  }
+
+  /* only the float argument is mandatory */
+  if (!argv[0]  ||  cmd->argtype == ArgNone  ||  cmd->argtype == ArgMouse)
+    return   !argv[0]
+         &&  cmd->argtype != ArgFloat  &&  cmd->argtype != ArgScratch;
+
+  if (argv[1])
+    return false;
+
+  switch (cmd->argtype)
+  {
+    case ArgInt:
+      arg->i = strtol(argv[0], &end, 10);
+      return *argv[0]  &&  !*end;
+
+    case ArgFloat:
+      arg->f = strtof(argv[0], &end);
+      return *argv[0]  &&  !*end;
+
+    case ArgTag:
+      if (!strcmp(argv[0], "all"))
+      {
+        arg->ui = ~0;
+        return true;
+      }
+      n = strtoul(argv[0], &end, 10);
+      if (!*argv[0]  ||  *end  ||  n < 1  ||  n > TAGS)
+        return false;
+      arg->ui = 1 << (n - 1);
+      return true;
+
+    case ArgLayout:
+      for (n = 0;  n < LENGTH(layouts);  n++)
+      {
+        if (!strcmp(argv[0], layouts[n].symbol))
+        {
+          arg->v = &layouts[n];
+          return true;
+        }
+      }
+      n = strtoul(argv[0], &end, 10);
+      if (!*argv[0]  ||  *end  ||  n >= LENGTH(layouts))
+        return false;
+      arg->v = &layouts[n];
+      return true;
+
+    case ArgScratch:
+      for (n = 0;  n < LENGTH(scratchpads);  n++)
+      {
+        if (!strcmp(argv[0], scratchpads[n].name))
+        {
+          arg->v = &scratchpads[n];
+          return true;
+        }
+      }
+      n = strtoul(argv[0], &end, 10);
+      if (!*argv[0]  ||  *end  ||  n >= LENGTH(scratchpads))
+        return false;
+      arg->v = &scratchpads[n];
+      return true;
+  }
+
+  return false;
+}
+
+/* Splits the text of b at its color codes into spans and measures
+ * them, returns the width of the block. */
+static int
+parsestatus(Block *b)
+{
+  const char *p, *q;
+  XftColor   *col = dc.colors[0];
+  Span       *s;
+  int         w = dc.font.height;
+
+  for (b->nspans = 0, p = q = b->text;  ;  q++)
+  {
+    if (*q > 0  &&  *q <= NUMCOLORS  &&  q == p)
+    {
+      /* consecutive codes only change the color */
+      col = dc.colors[*q - 1];
+      p++;
+    }
+    else if ((*q > 0  &&  *q <= NUMCOLORS)  ||  !*q)
+    {
+      b->spans = growarray(b->spans, b->nspans, sizeof(Span));
+      s        = &b->spans[b->nspans++];
+      s->col   = col;
+      s->off   = p - b->text;
+      s->len   = q - p;
+      s->w     = textnw(p, s->len);
+      w       += s->w;
+
+      if (!*q)
+        break;
+
+      col = dc.colors[*q - 1];
+      p   = q + 1;
+    }
+  }
+
+  return w;
+}
+
+/* Parses modifiers like "mod+shift", returns false if invalid. */
+static bool
+parsemods(const char *str, unsigned int *mods)
+{
+  static const struct {
+    const char   *name;
+    unsigned int  mask;
+  } names[] = {
+    { "mod",     MODKEY      },
+    { "shift",   ShiftMask   },
+    { "control", ControlMask },
+    { "ctrl",    ControlMask },
+    { "mod1",    Mod1Mask    },
+    { "mod2",    Mod2Mask    },
+    { "mod3",    Mod3Mask    },
+    { "mod4",    Mod4Mask    },
+    { "mod5",    Mod5Mask    },
+  };
+  unsigned int i;
+  size_t       len;
+
+  *mods = 0;
+  if (!strcmp(str, "none")  ||  !strcmp(str, "0"))
+    return true;
+
+  for ( ;  *str;  str += len + (str[len] == '+'))
+  {
+    len = strcspn(str, "+");
+
+    for (i = 0;  i < LENGTH(names);  i++)
+      if (strlen(names[i].name) == len  &&  !strncmp(str, names[i].name, len))
+        break;
+
+    if (i == LENGTH(names))
+      return false;
+
+    *mods |= names[i].mask;
+  }
+
+  return true;
+}
+
+/* Launches cmd for a warm pool or a scratchpad, its window is given
+ * to them by pendingmatch() once it is managed. */
+static bool
+pendingadd(const char **cmd, unsigned int pool, unsigned int scratch)
+{
+  pid_t pid;
+
+  if (npending >= MAXPENDING)
+    return false;
+
+  /* the pid is needed, so the launcher cannot be used */
+  if ((pid = spawnchild((char *const *)cmd, -1)) < 0)
+    return false;
+
+  pending[npending].pid     = pid;
+  pending[npending].pool    = pool;
+  pending[npending].scratch = scratch;
+  npending++;
+
+  return true;
+}
+
+/* Gives c to the warm pool or the scratchpad which launched it, found
+ * by its _NET_WM_PID. */
+static bool
+pendingmatch(Client *c)
+{
+  unsigned int i;
+  pid_t        pid;
+
+  if (!npending  ||  !(pid = getwinpid(c->win)))
+    return false;
+
+  for (i = 0;  i < npending;  i++)
+  {
+    if (pending[i].pid == pid)
+    {
+      c->pool    = pending[i].pool;
+      c->scratch = pending[i].scratch;
+      pending[i] = pending[--npending];
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* Forgets a command which exited before mapping a window.  Pools are
+ * refilled after a delay, so a failing command is not run in a
+ * loop. */
+static void
+pendingreap(pid_t pid)
+{
+  unsigned int i;
+
+  for (i = 0;  i < npending;  i++)
+  {
+    if (pending[i].pid == pid)
+    {
+      if (pending[i].pool  &&  !pooltimer)
+        pooltimer = addtimer(POOLDELAY, 0, poolrefill, NULL);
+      pending[i] = pending[--npending];
+      return;
+    }
+  }
+}
+
+static void
+pop(Client *c)
+{
+  detach(c);
+  attach(c);
+  focus(c);
+  arrange(c->mon);
+}
+
+/* Returns a ready client of pools[i], preferably on the selected
+ * monitor. */
+static Client *
+poolclient(unsigned int i)
+{
+  Monitor *m;
+  Client  *c, *found = NULL;
 
-  if ((m = recttomon(c->x, c->y, c->w, c->h))  !=  selmon)
-  {
-    sendmon(c, m);
-    selmon = m;
-    focus(NULL);
-  }
+  for (m = mons;  m;  m = m->next)
+    for (c = m->clients;  c;  c = c->next)
+      if (c->pool == i + 1  &&  (!found  ||  m == selmon))
+        found = c;
+
+  return found;
 }
 
+/* Launches the commands missing from the warm pools. */
 static void
-nametag(__attribute__((unused)) const Arg *arg)
+poolfill(void)
 {
-  char *p, buf[256];
-  FILE *f;
-  int   i;
-
-  snprintf(buf, sizeof(buf),
-    "dmenu -p '%s' -fn '%s' -nb '%s' -nf '%s' -sb '%s' -sf '%s' "
-    "</dev/null", "Current tag name: ",
-    font,
-    colors[0][ColBG],
-    colors[0][ColFG],
-    colors[1][ColBG],
-    colors[1][ColFG]);
+  unsigned int  i, j, n;
+  Monitor      *m;
+  Client       *c;
 
-  errno = 0; /* popen(3p) says on failure it "may" set errno */
-  if (!(f = popen(buf, "r")))
+  for (i = 0;  i < LENGTH(pools);  i++)
   {
-    fprintf(stderr, "rawm: nametag: Could not popen '%s'", buf);
-    if (errno)
-      fprintf(stderr, ": %s\n", strerror(errno));
-    else
-      fprintf(stderr, "\n");
-    return;
-  }
+    n = 0;
+    for (m = mons;  m;  m = m->next)
+      for (c = m->clients;  c;  c = c->next)
+        n += c->pool == i + 1;
+    for (j = 0;  j < npending;  j++)
+      n += pending[j].pool == i + 1;
 
-  if (!(p = fgets(buf, MAX_TAGNAMELEN, f))  &&  ferror(f))
-    fprintf(stderr, "rawm: nametag: fgets failed: %s\n",
-            strerror(errno));
+    for ( ;  n < pools[i].size;  n++)
+      if (!pendingadd(pools[i].cmd, i + 1, 0))
+        break;
+  }
+}
 
-  if (pclose(f) < 0)
-    fprintf(stderr, "rawm: nametag: pclose failed: %s\n",
-            strerror(errno));
+/* Returns the index in pools of the command spawned with argv, -1 if
+ * it has no warm pool. */
+static int
+poolfind(const char *const argv[])
+{
+  unsigned int i, j;
 
-  if (!p)
-    return;
+  for (i = 0;  i < LENGTH(pools);  i++)
+  {
+    if (!pools[i].cmd)
+      continue;
 
-  if ((p = strchr(buf, '\n')))
-    *p = '\0';
+    for (j = 0;  argv[j]  &&  pools[i].cmd[j];  j++)
+      if (strcmp(argv[j], pools[i].cmd[j]))
+        break;
 
-  for (i = 0; i < TAGS; i++)
-  {
-    if (selmon->tagset[selmon->seltags] & (1 << i))
-    {
-      if (strlen(buf))
-        sprintf(tags[selmon->num][i].tagname, "%i/%s", i+1, buf);
-      else
-        sprintf(tags[selmon->num][i].tagname, "%i",    i+1);
-    }
+    if (!argv[j]  &&  !pools[i].cmd[j]  &&  pools[i].size)
+      return i;
   }
 
-  drawbar(selmon);
+  return -1;
 }
 
-static Client *
-nexttiled(Client *c)
+static void
+poolrefill(__attribute__((unused)) void *arg)
 {
-  for ( ;  c && (c->isfloating || !ISVISIBLE(c));  c = c->next)
-    /* NOTHING */;
-
-  return c;
+  pooltimer = NULL;
+  poolfill();
 }
 
+/* Reports the time spent since the previous phase of startup, if
+ * enabled by -t.  A NULL phase starts the clock. */
 static void
-pop(Client *c)
+profilephase(const char *phase)
 {
-  detach(c);
-  attach(c);
-  focus(c);
-  arrange(c->mon);
+  struct timespec ts;
+  long long       now;
+
+  if (!profile)
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  now = (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+  if (!phase)
+    profilestart = now;
+  else
+    fprintf(stderr, "rawm: startup: %-12s %8.3f ms %8.3f ms total\n",
+            phase, (now - profilelast) / 1000.0,
+            (now - profilestart) / 1000.0);
+  profilelast = now;
 }
 
 static void
@@ -2712,7 +5509,6 @@ propertynotify(XEvent *e)
     else
       updatesystrayiconstate(c, ev);
 
-    resizebarwin(selmon);
     updatesystray();
   }
 #endif /* SYSTRAY */
@@ -2720,7 +5516,21 @@ propertynotify(XEvent *e)
   if ((ev->window == root)  &&  (ev->atom == XA_WM_NAME))
     updatestatus();
   else if (ev->state == PropertyDelete)
-    return; /* ignore */
+  {
+    /* only the cached client properties care about removal */
+    if ((c = wintoclient(ev->window)))
+    {
+      if (ev->atom == wmatom[WMProtocols])
+        c->protocols = 0;
+      else if (ev->atom == XA_WM_HINTS)
+        c->haswmh = false;
+      else if (ev->atom == netatom[NetWMState])
+        c->winstate = None;
+      else if (ev->atom == netatom[NetWMWindowType])
+        c->wintype = None;
+    }
+    return;
+  }
   else if ((c = wintoclient(ev->window)))
   {
     switch (ev->atom)
@@ -2757,8 +5567,15 @@ propertynotify(XEvent *e)
         drawbar(c->mon);
     }
 
-    if (ev->atom == netatom[NetWMWindowType])
+    if (ev->atom == wmatom[WMProtocols])
+      updateprotocols(c);
+    else if (ev->atom == netatom[NetWMState])
+      c->winstate = getatomprop(c, netatom[NetWMState]);
+    else if (ev->atom == netatom[NetWMWindowType])
+    {
+      c->wintype = getatomprop(c, netatom[NetWMWindowType]);
       updatewindowtype(c);
+    }
   }
 }
 
@@ -2807,6 +5624,8 @@ removesystrayicon(Client *i)
   if (ii)
     *ii = i->next;
 
+  /* the following icons move into the gap */
+  setsystraydirty(i->next);
   free(i);
 }
 #endif /* SYSTRAY */
@@ -2937,51 +5756,399 @@ resizemouse(__attribute__((unused)) const Arg *arg)
           togglefloating(NULL);
       }
 
-      if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
-        resize(c, c->x, c->y, nw, nh, true);
+      if (!selmon->lt[selmon->sellt]->arrange || c->isfloating)
+        resize(c, c->x, c->y, nw, nh, true);
+
+      break;
+    }
+  } while (ev.type != ButtonRelease);
+
+  XWarpPointer(dpy,
+               None,
+               c->win,
+               0,
+               0,
+               0,
+               0,
+               c->w + c->bw - 1,
+               c->h + c->bw - 1
+               );
+  XUngrabPointer(dpy, CurrentTime);
+
+  while (XCheckMaskEvent(dpy, EnterWindowMask, &ev))
+    /* NOTHING */;
+
+  if ((m = recttomon(c->x, c->y, c->w, c->h))  !=  selmon)
+  {
+    sendmon(c, m);
+    selmon = m;
+    focus(NULL);
+  }
+}
+
+#ifdef SYSTRAY
+void
+resizerequest(XEvent *e)
+{
+  XResizeRequestEvent *ev = &e->xresizerequest;
+  Client *i;
+
+  if ((i = wintosystrayicon(ev->window)))
+  {
+    updatesystrayicongeom(i, ev->width, ev->height);
+    updatesystray();
+  }
+}
+#endif /* SYSTRAY */
+
+/* Reads the file at path into buf as a string, without stdio, and
+ * returns its length or -1. */
+static ssize_t
+readfile(const char *path, char *buf, size_t size)
+{
+  ssize_t n;
+  int     fd;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return -1;
+
+  n = read(fd, buf, size - 1);
+  close(fd);
+
+  buf[n > 0 ? n : 0] = '\0';
+
+  return n;
+}
+
+/* Collects the answer of the prompt opened by nametag() and names
+ * the tags with its first line once it is complete. */
+static void
+readprompt(int fd, __attribute__((unused)) short revents,
+           __attribute__((unused)) void *arg)
+{
+  char     buf[256], *nl = NULL;
+  ssize_t  n;
+  size_t   len;
+  Monitor *m;
+  int      i;
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+  {
+    len = n;
+    if ((nl = memchr(buf, '\n', n)))
+      len = nl - buf;
+
+    /* longer answers are cut, as fgets(3) used to */
+    if (len > sizeof(prompt.buf) - 1 - prompt.len)
+      len = sizeof(prompt.buf) - 1 - prompt.len;
+
+    memcpy(prompt.buf + prompt.len, buf, len);
+    prompt.len += len;
+
+    if (nl)
+      break;
+  }
+
+  if (!nl  &&  n != 0  &&  (errno == EAGAIN  ||  errno == EINTR))
+    return;
+
+  if (!nl  &&  n < 0)
+    fprintf(stderr, "rawm: nametag: read failed: %s\n",
+            strerror(errno));
+
+  delwatch(fd);
+  close(fd);
+  prompt.fd = -1;
+  prompt.buf[prompt.len] = '\0';
+
+  /* the prompt was closed without an answer */
+  if (!nl  &&  !prompt.len)
+    return;
+
+  for (m = mons;  m  &&  m->num != prompt.mon;  m = m->next)
+    /* NOTHING */;
+
+  if (!m)
+    return;
+
+  for (i = 0; i < TAGS; i++)
+  {
+    if (prompt.tags & (1 << i))
+    {
+      if (prompt.len)
+        sprintf(tags[m->num][i].tagname, "%i/%s", i+1, prompt.buf);
+      else
+        sprintf(tags[m->num][i].tagname, "%i",    i+1);
+    }
+  }
+
+  drawbar(m);
+}
+
+/* Processes the signals noted by sighandler(). */
+static void
+readsignals(int fd, __attribute__((unused)) short revents,
+            __attribute__((unused)) void *arg)
+{
+  unsigned char buf[64];
+  ssize_t       i, n;
+  pid_t         pid;
+  Arg           a;
+
+  /* the pipe is non-blocking, the loop ends with EAGAIN once empty */
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+  {
+    for (i = 0;  i < n;  i++)
+    {
+      switch (buf[i])
+      {
+        case SIGCHLD:
+          while (0 < (pid = waitpid(-1, NULL, WNOHANG)))
+            pendingreap(pid);
+          break;
+
+        case SIGUSR1:
+          reload(NULL);
+          break;
+
+        case SIGHUP:
+        case SIGTERM:
+          a.i = buf[i] == SIGHUP;
+          quit(&a);
+          break;
+      }
+    }
+  }
+}
+
+/* Reads "name text" lines from the status FIFO, setting block name to
+ * text, or removing it if there is no text. */
+static void
+readstatus(int fd, __attribute__((unused)) short revents,
+           __attribute__((unused)) void *arg)
+{
+  char    buf[4096], *p, *nl, *text;
+  ssize_t n;
+  size_t  len;
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+  {
+    for (p = buf;  p < buf + n;  p = nl + 1)
+    {
+      if (!(nl = memchr(p, '\n', buf + n - p)))
+        nl = buf + n;
+
+      len = nl - p;
+      if (statusskip  ||  statuslen + len >= sizeof(statusin))
+      {
+        /* drop too long lines */
+        statusskip = nl < buf + n ? false : true;
+        statuslen  = 0;
+        continue;
+      }
+
+      memcpy(statusin + statuslen, p, len);
+      statuslen += len;
+
+      if (nl == buf + n)
+        break;
+
+      statusin[statuslen] = '\0';
+      statuslen           = 0;
+
+      if ((text = strpbrk(statusin, " \t")))
+        *text++ = '\0';
+
+      if (*statusin)
+        setblock(statusin, text);
+    }
+  }
+}
+
+/* Reads the runtime configuration file again and rebuilds what
+ * depends on it: key and button grabs, colors, borders and bars. */
+static void
+reload(__attribute__((unused)) const Arg *arg)
+{
+  Config   old = cfg;
+  char     oldcolors[NUMCOLORS][ColLast][MAXCOLORNAME];
+  Monitor *m;
+  Client  *c;
+  int      i, j;
+
+  memcpy(oldcolors, colornames, sizeof(colornames));
+  loadconfig(&cfg);
+  freeconfig(&old);
+
+  grabkeys();
+
+  if (memcmp(oldcolors, colornames, sizeof(colornames)))
+  {
+    for (i = 0;  i < NUMCOLORS;  i++)
+    {
+      for (j = 0;  j < ColLast;  j++)
+      {
+        if (strcmp(oldcolors[i][j], colornames[i][j]))
+        {
+          XftColorFree(dpy, DefaultVisual(dpy, screen),
+                       DefaultColormap(dpy, screen), &dc.colors[i][j]);
+          dc.colors[i][j] = getcolor(colornames[i][j]);
+        }
+      }
+    }
+
+#ifdef SYSTRAY
+    /* repaint the systray background */
+    if (systray)
+      systray->mon = NULL;
+#endif /* SYSTRAY */
+
+    /* statuspix holds the status in the old colors */
+    statusfull = statusdirty = true;
+  }
+
+  for (m = mons;  m;  m = m->next)
+  {
+    for (c = m->clients;  c;  c = c->next)
+    {
+      grabbuttons(c, c == selmon->sel);
+      XSetWindowBorder(dpy, c->win,
+                       c == selmon->sel ? dc.colors[1][ColBorder].pixel
+                       : c->isurgent    ? dc.colors[2][ColFG].pixel
+                       :                  dc.colors[0][ColBorder].pixel);
+    }
+  }
+
+  arrange(NULL);
+#ifdef SYSTRAY
+  updatesystray();
+#endif /* SYSTRAY */
+  for (m = mons;  m;  m = m->next)
+    drawbar(m);
+}
+
+/* Draws the bar of m and copies it to its window. */
+static void
+renderbar(Monitor *m)
+{
+  int           x, sx;
+  unsigned int  i, occ, urg;
+  XftColor     *col;
+
+  if (m->barpixw != m->ww)
+  {
+    if (m->barpix)
+      XFreePixmap(dpy, m->barpix);
+
+    m->barpix  = XCreatePixmap(dpy, root, m->ww, bh,
+                               DefaultDepth(dpy, screen));
+    m->barpixw = m->ww;
+  }
+  dc.drawable = m->barpix;
+
+  getbarstate(m, &m->bar);
+  occ = m->bar.occ;
+  urg = m->bar.urg;
+
+  dc.x     = 0;
+  m->nsegs = 0;
+
+  for (i = 0; i < TAGS; i++)
+  {
+    /* do not draw vacant tags */
+    if (!(occ & 1 << i || m->tagset[m->seltags] & 1 << i))
+      continue;
+
+    dc.w = TEXTW(tags[m->num][i].tagname);
+    addsegment(m, dc.x, ClkTagBar, 1 << i);
+
+    col = dc.colors[ (  m->tagset[ m->seltags ] & 1 << i
+                      ? 1
+                      : (urg & 1 << i ? 2 : 0)
+                      ) ];
+
+    drawtext(tags[m->num][i].tagname, col, true);
+
+    drawsquare(   m == selmon
+               && selmon->sel
+               && selmon->sel->tags & 1 << i,
+               occ & 1 << i,
+               col
+               );
+
+    dc.x += dc.w;
+  }
+
+  /* draw layout */
+  dc.w  = TEXTW(m->ltsymbol);
+  addsegment(m, dc.x, ClkLtSymbol, 0);
+  drawtext(m->ltsymbol, dc.colors[0], true);
+  dc.x += dc.w;
+  x     = dc.x;
+
+#ifdef WINTITLE
+  addsegment(m, x, ClkWinTitle, 0);
+#else
+  addsegment(m, x, ClkStatusText, 0);
+#endif /* WINTITLE */
+
+  m->statusx = -1;
+  if (SHOWSTATUS(m))
+  {
+    /* the status is copied from statuspix, see flushstatus() */
+    dc.w = statusw;
+    dc.x = m->ww - dc.w;
 
-      break;
+#ifdef SYSTRAY
+    if (showsystray  &&  m == selmon)
+      dc.x -= getsystraywidth();
+#endif /* SYSTRAY */
+
+    m->statusx = dc.x;
+    if (dc.x < x)
+    {
+      dc.x       = x;
+      dc.w       = m->ww - x;
+      m->statusx = -1;
     }
-  } while (ev.type != ButtonRelease);
 
-  XWarpPointer(dpy,
-               None,
-               c->win,
-               0,
-               0,
-               0,
-               0,
-               c->w + c->bw - 1,
-               c->h + c->bw - 1
-               );
-  XUngrabPointer(dpy, CurrentTime);
+    if (statuspix  &&  dc.w > 0)
+      XCopyArea(dpy, statuspix, m->barpix, dc.gc, 0, 0,
+                MIN(dc.w, statuspixw), bh, dc.x, 0);
 
-  while (XCheckMaskEvent(dpy, EnterWindowMask, &ev))
-    /* NOTHING */;
+    for (i = 0, sx = dc.x;  i < nblocks;  sx += blocks[i++].w)
+      if (blocks[i].w)
+        addsegment(m, sx, ClkStatusText, i);
+  }
+  else
+    dc.x = m->ww;
 
-  if ((m = recttomon(c->x, c->y, c->w, c->h))  !=  selmon)
+  if ((dc.w = dc.x - x) > bh)
   {
-    sendmon(c, m);
-    selmon = m;
-    focus(NULL);
-  }
-}
+    dc.x = x;
+#ifdef WINTITLE
+    if (m->sel)
+    {
+      /* is monitor selected? draw dc.colors[1] then */
+      col = m == selmon ? dc.colors[1] : dc.colors[0];
+      drawtext(m->sel->name, col, true);
 
-#ifdef SYSTRAY
-void
-resizerequest(XEvent *e)
-{
-  XResizeRequestEvent *ev = &e->xresizerequest;
-  Client *i;
+      drawsquare(m->sel->isfixed, m->sel->isfloating, col);
 
-  if ((i = wintosystrayicon(ev->window)))
-  {
-    updatesystrayicongeom(i, ev->width, ev->height);
-    resizebarwin(selmon);
-    updatesystray();
+      /* or draw normal colors, no matter what monitor it is */
+      //drawtext(m->sel->name, dc.colors[0], true);
+      //drawsquare(m->sel->isfixed, m->sel->isfloating, dc.colors[1]);
+    }
+    else
+#endif /* WINTITLE */
+      drawtext(NULL, dc.colors[0], false);
   }
+
+  XCopyArea(dpy, dc.drawable, m->barwin, dc.gc, 0, 0, m->ww, bh, 0, 0);
+  m->bardirty = false;
+  barrenders++;
+  barblits++;
 }
-#endif /* SYSTRAY */
 
 static void
 restack(Monitor *m)
@@ -2990,7 +6157,7 @@ restack(Monitor *m)
   XEvent          ev;
   XWindowChanges  wc;
 
-  drawbar(m);
+  drawbars();
 
   if (!m->sel)
     return;
@@ -3019,18 +6186,264 @@ restack(Monitor *m)
     /* NOTHING */;
 }
 
+/* Applies the state c had before a restart. */
+static void
+restoreclient(Client *c, SavedClient *s)
+{
+  Monitor *m;
+
+  for (m = mons;  m && m->num != s->mon;  m = m->next)
+    /* NOTHING */;
+
+  c->mon        = m ? m : selmon;
+  c->tags       = (s->tags & TAGMASK)
+                ? (s->tags & TAGMASK)
+                :  c->mon->tagset[c->mon->seltags];
+  c->isfloating = c->oldstate = s->isfloating;
+  c->x          = c->oldx     = s->x;
+  c->y          = c->oldy     = s->y;
+  c->w          = c->oldw     = s->w;
+  c->h          = c->oldh     = s->h;
+  c->oldbw      = s->oldbw;
+#ifdef PWKL
+  c->kbdgrp     = s->kbdgrp;
+#endif /* PWKL */
+
+  /* a pool gone from the configuration leaves its window shown */
+  if (s->pool  &&  s->pool <= LENGTH(pools)  &&  pools[s->pool - 1].cmd)
+  {
+    c->pool = s->pool;
+    c->tags = 0;
+  }
+
+  /* hidden scratchpads have no tags */
+  if (s->scratch  &&  s->scratch <= LENGTH(scratchpads))
+  {
+    c->scratch = s->scratch;
+    c->tags    = s->tags & TAGMASK;
+  }
+}
+
+/* Restores the client and stack order and selection of the previous
+ * process once scan() managed all windows. */
+static void
+restoreorder(void)
+{
+  Client       *c;
+  unsigned int  i;
+
+  for (i = nsavedstack;  i-- > 0; )
+  {
+    if ((c = wintoclient(savedstack[i])))
+    {
+      detachstack(c);
+      attachstack(c);
+    }
+  }
+
+  for (i = nsaved;  i-- > 0; )
+  {
+    if ((c = wintoclient(saved[i].win)))
+    {
+      detach(c);
+      attach(c);
+      if (saved[i].issel  &&  ISVISIBLE(c))
+        c->mon->sel = c;
+    }
+  }
+
+  free(saved);
+  free(savedstack);
+  saved       = NULL;
+  savedstack  = NULL;
+  nsaved      = nsavedstack = 0;
+}
+
 static void
 run(void)
 {
   XEvent ev;
+  int    i, j, n, timeout;
 
   /* main event loop */
   XSync(dpy, false);
-  while (running  &&  !XNextEvent(dpy, &ev))
+  while (running)
+  {
+    /* handle every event which is queued or can be read without
+     * blocking, after flushing the requests issued so far */
+    while (running  &&  XEventsQueued(dpy, QueuedAfterFlush))
+    {
+      XNextEvent(dpy, &ev);
+
+      if (ev.type < LASTEvent  &&  handler[ev.type])
+        handler[ev.type](&ev); /* call handler */
+#ifdef PWKL
+      else if (ev.type == xkbevent)
+        xkbstatenotify(&ev);
+#endif /* PWKL */
+    }
+
+    if (!running)
+      break;
+
+    timeout = runtimers();
+
+    /* timers may have read events into the queue while waiting for
+     * replies, which poll(2) would not report */
+    if (XEventsQueued(dpy, QueuedAlready))
+      continue;
+
+    /* bars and status blocks changed by the handlers and timers
+     * above, or by earlier ones if the last frame is too recent */
+    if ((n = flushbars()) >= 0  &&  (timeout < 0  ||  n < timeout))
+      timeout = n;
+#ifdef IPC
+    ipcpublish();
+#endif /* IPC */
+
+    XFlush(dpy);
+
+    /* drop watches removed by callbacks */
+    for (i = j = 0;  i < nwatches;  i++)
+    {
+      if (pfds[i].fd >= 0)
+      {
+        pfds[j]    = pfds[i];
+        watches[j] = watches[i];
+        j++;
+      }
+    }
+    nwatches = j;
+
+    if ((n = poll(pfds, nwatches, timeout)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      die("rawm: poll failed: %s\n", strerror(errno));
+    }
+
+    for (i = 0;  n > 0  &&  i < nwatches;  i++)
+    {
+      if (!pfds[i].revents)
+        continue;
+
+      n--;
+      if (pfds[i].fd >= 0  &&  watches[i].func)
+        watches[i].func(pfds[i].fd, pfds[i].revents, watches[i].arg);
+    }
+  }
+}
+
+/* Runs all expired timers, and those expiring within TIMERSLACK so
+ * that close timers share a wakeup, and returns the time in
+ * milliseconds until the next one expires, or -1 if there are none. */
+static int
+runtimers(void)
+{
+  long long  now = clockms();
+  Timer     *t, **tp;
+  void     (*func)(void *);
+  void      *arg;
+
+  while (timers  &&  timers->when <= now + TIMERSLACK)
+  {
+    t      = timers;
+    timers = t->next;
+    func   = t->func;
+    arg    = t->arg;
+
+    if (t->interval)
+    {
+      /* re-arm, skipping expiries missed while busy */
+      for (t->when += t->interval;  t->when <= now;  t->when += t->interval)
+        /* NOTHING */;
+
+      for (tp = &timers;  *tp && (*tp)->when <= t->when;  tp = &(*tp)->next)
+        /* NOTHING */;
+      t->next = *tp;
+      *tp     = t;
+    }
+    else
+      free(t);
+
+    func(arg);
+  }
+
+  if (!timers)
+    return -1;
+
+  return timers->when - now > INT_MAX ? INT_MAX : (int)(timers->when - now);
+}
+
+/* Writes the state which does not survive an exec to an unlinked
+ * file, whose descriptor is passed to the new process in RAWM_STATE. */
+static void
+savestate(void)
+{
+  FILE    *f;
+  Monitor *m;
+  Client  *c;
+  Pertag  *pt;
+  char     buf[16];
+  int      i;
+
+  if (!(f = tmpfile()))
+  {
+    fprintf(stderr, "rawm: cannot save state: %s\n", strerror(errno));
+    return;
+  }
+
+  fprintf(f, "selmon %d\n", selmon->num);
+
+  for (m = mons;  m;  m = m->next)
+  {
+    pt = m->pertag;
+    fprintf(f, "monitor %d %u %u %u %u %d %d %.9g %d %d %u %u %#lx\n",
+            m->num, m->seltags, m->sellt, m->tagset[0], m->tagset[1],
+            (int)(m->lt[0] - layouts), (int)(m->lt[1] - layouts),
+            m->mfact, m->nmaster, m->showbar, pt->curtag, pt->prevtag,
+            m->sel ? m->sel->win : None);
+
+    for (i = 0;  i <= TAGS;  i++)
+      fprintf(f, "pertag %d %d %d %.9g %u %d %d %d\n",
+              m->num, i, pt->nmasters[i], pt->mfacts[i], pt->sellts[i],
+              (int)(pt->ltidxs[i][0] - layouts),
+              (int)(pt->ltidxs[i][1] - layouts), pt->showbars[i]);
+
+    for (i = 0;  i < TAGS;  i++)
+      fprintf(f, "tagname %d %d %s\n", m->num, i, tags[m->num][i].tagname);
+
+    for (c = m->clients;  c;  c = c->next)
+      fprintf(f, "client %#lx %d %u %d %d %d %d %d %d %u %u %u\n",
+              c->win, m->num, c->tags,
+              c->isfullscreen ? c->oldstate : c->isfloating,
+              c->isfullscreen ? c->oldx     : c->x,
+              c->isfullscreen ? c->oldy     : c->y,
+              c->isfullscreen ? c->oldw     : c->w,
+              c->isfullscreen ? c->oldh     : c->h,
+              c->oldbw,
+#ifdef PWKL
+              c->kbdgrp,
+#else
+              0,
+#endif /* PWKL */
+              c->pool, c->scratch);
+
+    for (c = m->stack;  c;  c = c->snext)
+      fprintf(f, "stack %#lx\n", c->win);
+  }
+
+  rewind(f);
+  if (ferror(f))
   {
-    if (handler[ev.type])
-      handler[ev.type](&ev); /* call handler */
+    fprintf(stderr, "rawm: cannot save state\n");
+    fclose(f);
+    return;
   }
+
+  fcntl(fileno(f), F_SETFD, 0);
+  snprintf(buf, sizeof(buf), "%d", fileno(f));
+  setenv("RAWM_STATE", buf, 1);
 }
 
 static void
@@ -3040,6 +6453,8 @@ scan(void)
   Window            d1, d2, *wins = NULL;
   XWindowAttributes wa;
 
+  scanning = true;
+
   if (XQueryTree(dpy, root, &d1, &d2, &wins, &num))
   {
     for (unsigned int i = 0; i < num; i++)
@@ -3072,6 +6487,14 @@ scan(void)
     if (wins)
       XFree(wins);
   }
+
+  scanning = false;
+
+  /* a single layout pass for all windows */
+  restoreorder();
+  arrange(NULL);
+  focus(NULL);
+  poolfill();
 }
 
 static void
@@ -3093,6 +6516,77 @@ sendmon(Client *c, Monitor *m)
   arrange(NULL);
 }
 
+#ifdef SYSTRAY
+/* Marks the systray icon i and all icons placed after it to be
+ * repositioned by the next updatesystray(). */
+static void
+setsystraydirty(Client *i)
+{
+  for ( ;  i;  i = i->next)
+    i->isdirty = true;
+}
+#endif /* SYSTRAY */
+
+/* Sets the text of the status block name, which is created if needed.
+ * A NULL text removes the block.  Only the changed block is parsed and
+ * measured again, the result is shown by flushstatus(). */
+static void
+setblock(const char *name, const char *text)
+{
+  unsigned int  i;
+  Block        *b;
+  int           w;
+
+  for (i = 0;  i < nblocks  &&  strcmp(blocks[i].name, name);  i++)
+    /* NOTHING */;
+
+  if (i == nblocks)
+  {
+    if (!text)
+      return;
+
+    blocks = growarray(blocks, nblocks, sizeof(Block));
+    b        = &blocks[nblocks++];
+    b->spans  = NULL;
+    b->nspans = 0;
+    b->w      = 0;
+    b->dirty  = false;
+    if (!(b->name = strdup(name))  ||  !(b->text = strdup("")))
+      die("fatal: could not malloc() %u bytes\n", strlen(name) + 1);
+
+    /* the version is only a placeholder for a missing status */
+    if (i  &&  !strcmp(blocks[0].text, "rawm "VERSION))
+      setblock(blocks[0].name, "");
+  }
+
+  b = &blocks[i];
+
+  if (!text)
+  {
+    statusw -= b->w;
+    free(b->name);
+    free(b->text);
+    free(b->spans);
+    memmove(b, b + 1, (--nblocks - i) * sizeof(Block));
+    statusdirty = statusfull = true;
+    return;
+  }
+
+  if (!strcmp(b->text, text))
+    return;
+
+  free(b->text);
+  if (!(b->text = strdup(text)))
+    die("fatal: could not malloc() %u bytes\n", strlen(text) + 1);
+
+  w           = *text ? parsestatus(b) : 0;
+  statusw    += w - b->w;
+  statusfull  = statusfull  ||  w != b->w;
+  b->w        = w;
+  b->dirty    = true;
+  statusdirty = true;
+}
+
 static void
 setclientstate(Client *c, long state)
 {
@@ -3114,24 +6608,17 @@ static bool
 sendevent(Window w, Atom proto, int mask,
     long d0, long d1, long d2, long d3, long d4)
 {
-  int     n;
-  Atom   *protocols, mt;
+  Atom    mt;
   bool    exists = false;
+  Client *c;
   XEvent  ev;
 
   if (   proto == wmatom[WMTakeFocus]
       || proto == wmatom[WMDelete]
       )
   {
-    mt = wmatom[WMProtocols];
-
-    if (XGetWMProtocols(dpy, w, &protocols, &n))
-    {
-      while (!exists && n--)
-        exists = protocols[n] == proto;
-
-      XFree(protocols);
-    }
+    mt     = wmatom[WMProtocols];
+    exists = (c = wintoclient(w))  &&  hasprotocol(c, proto);
   }
   else
   {
@@ -3160,19 +6647,9 @@ sendevent(Window w, Atom proto, int mask,
 static bool
 sendevent(Client *c, Atom proto)
 {
-  int     n;
-  Atom   *protocols;
-  bool    exists = false;
+  bool    exists = hasprotocol(c, proto);
   XEvent  ev;
 
-  if (XGetWMProtocols(dpy, c->win, &protocols, &n))
-  {
-    while (!exists && n--)
-      exists = protocols[n] == proto;
-
-    XFree(protocols);
-  }
-
   if (exists)
   {
     ev.type                 = ClientMessage;
@@ -3234,6 +6711,7 @@ setfullscreen(Client *c, bool fullscreen)
                     1
                     );
 
+    c->winstate     = netatom[NetWMFullscreen];
     c->isfullscreen = true;
     c->oldstate     = c->isfloating;
     c->oldbw        = c->bw;
@@ -3255,6 +6733,7 @@ setfullscreen(Client *c, bool fullscreen)
                     0
                     );
 
+    c->winstate     = None;
     c->isfullscreen = false;
     c->isfloating   = c->oldstate;
     c->bw           = c->oldbw;
@@ -3323,69 +6802,124 @@ static void
 setup(void)
 {
   XSetWindowAttributes wa;
+  struct sigaction     sa;
+  const char          *env;
+  int                  i;
+#ifdef SYSTRAY
+  char                *atomnames[WMLast + NetLast + XLast];
+#else
+  char                *atomnames[WMLast + NetLast];
+#endif /* SYSTRAY */
+  char               **wmnames  = atomnames;
+  char               **netnames = atomnames + WMLast;
+#ifdef SYSTRAY
+  char               **xnames   = atomnames + WMLast + NetLast;
+#endif /* SYSTRAY */
+  Atom                 atoms[LENGTH(atomnames)];
+
+  /* signals are only noted by the handler and processed by the main
+   * loop through a self-pipe */
+  if (pipe(sigpipe) < 0)
+    die("rawm: cannot create signal pipe\n");
+  for (i = 0;  i < 2;  i++)
+  {
+    fcntl(sigpipe[i], F_SETFD, FD_CLOEXEC);
+    fcntl(sigpipe[i], F_SETFL, fcntl(sigpipe[i], F_GETFL) | O_NONBLOCK);
+  }
+
+  memset(&sa, 0, sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_handler = sighandler;
+  sa.sa_flags   = SA_RESTART;
+  sigaction(SIGHUP,  &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGUSR1, &sa, NULL);
+  sa.sa_flags  |= SA_NOCLDSTOP;
+  sigaction(SIGCHLD, &sa, NULL);
 
   /* clean up any zombies immediately */
-  sigchld(0);
+  while (0 < waitpid(-1, NULL, WNOHANG))
+    /* NOTHING */;
+
+  fcntl(ConnectionNumber(dpy), F_SETFD, FD_CLOEXEC);
+  addwatch(ConnectionNumber(dpy), POLLIN, NULL, NULL);
+  addwatch(sigpipe[0], POLLIN, readsignals, NULL);
 
-  signal(SIGHUP,  sighup);
-  signal(SIGTERM, sigterm);
+#ifdef IPC
+  ipcsetup();
+#endif /* IPC */
+  statussetup();
+  /* tells children which display RAWM_SOCKET and RAWM_STATUS are for */
+  setenv("RAWM_DISPLAY", (env = getenv("DISPLAY")) ? env : "", 1);
 
   /* init screen */
   screen  = DefaultScreen(dpy);
   root    = RootWindow(dpy, screen);
 
-  initfont(font);
-
-  sw = DisplayWidth(dpy, screen);
-  sh = DisplayHeight(dpy, screen);
-  bh = dc.h = user_bh ? user_bh : dc.font.height + 2;
-
-  updategeom();
-
-  /* init atoms */
-  wmatom[WMProtocols]               = XInternAtom(dpy, "WM_PROTOCOLS",                 false);
-  wmatom[WMDelete]                  = XInternAtom(dpy, "WM_DELETE_WINDOW",             false);
-  wmatom[WMState]                   = XInternAtom(dpy, "WM_STATE",                     false);
-  wmatom[WMTakeFocus]               = XInternAtom(dpy, "WM_TAKE_FOCUS",                false);
+  /* init atoms, interned in a single round trip */
+  wmnames[WMProtocols]               = "WM_PROTOCOLS";
+  wmnames[WMDelete]                  = "WM_DELETE_WINDOW";
+  wmnames[WMState]                   = "WM_STATE";
+  wmnames[WMTakeFocus]               = "WM_TAKE_FOCUS";
 
-  netatom[NetActiveWindow]          = XInternAtom(dpy, "_NET_ACTIVE_WINDOW",           false);
-  netatom[NetSupported]             = XInternAtom(dpy, "_NET_SUPPORTED",               false);
+  netnames[NetActiveWindow]          = "_NET_ACTIVE_WINDOW";
+  netnames[NetSupported]             = "_NET_SUPPORTED";
+#ifdef SYSTRAY
+  netnames[NetSystemTray]            = "_NET_SYSTEM_TRAY_S0";
+  netnames[NetSystemTrayOP]          = "_NET_SYSTEM_TRAY_OPCODE";
+  netnames[NetSystemTrayOrientation] = "_NET_SYSTEM_TRAY_ORIENTATION";
+#endif /* SYSTRAY */
+  netnames[NetWMName]                = "_NET_WM_NAME";
+  netnames[NetWMState]               = "_NET_WM_STATE";
+  netnames[NetClientList]            = "_NET_CLIENT_LIST";
+  netnames[NetWMFullscreen]          = "_NET_WM_STATE_FULLSCREEN";
+  netnames[NetWMWindowOpacity]       = "_NET_WM_WINDOW_OPACITY";
+  netnames[NetWMPid]                 = "_NET_WM_PID";
+  netnames[NetWMWindowType]          = "_NET_WM_WINDOW_TYPE";
+  netnames[NetWMWindowTypeDialog]    = "_NET_WM_WINDOW_TYPE_DIALOG";
 #ifdef SYSTRAY
-  netatom[NetSystemTray]            = XInternAtom(dpy, "_NET_SYSTEM_TRAY_S0",          false);
-  netatom[NetSystemTrayOP]          = XInternAtom(dpy, "_NET_SYSTEM_TRAY_OPCODE",      false);
-  netatom[NetSystemTrayOrientation] = XInternAtom(dpy, "_NET_SYSTEM_TRAY_ORIENTATION", false);
+  xnames[Manager]                    = "MANAGER";
+  xnames[Xembed]                     = "_XEMBED";
+  xnames[XembedInfo]                 = "_XEMBED_INFO";
 #endif /* SYSTRAY */
-  netatom[NetWMName]                = XInternAtom(dpy, "_NET_WM_NAME",                 false);
-  netatom[NetWMState]               = XInternAtom(dpy, "_NET_WM_STATE",                false);
-  netatom[NetClientList]            = XInternAtom(dpy, "_NET_CLIENT_LIST",             false);
-  netatom[NetWMFullscreen]          = XInternAtom(dpy, "_NET_WM_STATE_FULLSCREEN",     false);
-  netatom[NetWMWindowType]          = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE",          false);
-  netatom[NetWMWindowTypeDialog]    = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG",   false);
+
+  XInternAtoms(dpy, atomnames, LENGTH(atomnames), false, atoms);
+  memcpy(wmatom,  atoms,          sizeof(wmatom));
+  memcpy(netatom, atoms + WMLast, sizeof(netatom));
 #ifdef SYSTRAY
-  xatom[Manager]                    = XInternAtom(dpy, "MANAGER",                      false);
-  xatom[Xembed]                     = XInternAtom(dpy, "_XEMBED",                      false);
-  xatom[XembedInfo]                 = XInternAtom(dpy, "_XEMBED_INFO",                 false);
+  memcpy(xatom,   atoms + WMLast + NetLast, sizeof(xatom));
 #endif /* SYSTRAY */
+  profilephase("atoms");
+
+  loadconfig(&cfg);
+  profilephase("config");
 
   /* init cursors */
   cursor[CurNormal]  = XCreateFontCursor(dpy, XC_left_ptr);
   cursor[CurResize]  = XCreateFontCursor(dpy, XC_sizing);
   cursor[CurMove]    = XCreateFontCursor(dpy, XC_fleur);
 
-  /* init appearance */
-  for (int i = 0; i < NUMCOLORS; i++)
-  {
-    dc.colors[i][ColBorder] = getcolor(colors[i][ColBorder]);
-    dc.colors[i][ColFG]     = getcolor(colors[i][ColFG]);
-    dc.colors[i][ColBG]     = getcolor(colors[i][ColBG]);
-  }
+  /* init appearance */
+  for (int i = 0; i < NUMCOLORS; i++)
+  {
+    dc.colors[i][ColBorder] = getcolor(colornames[i][ColBorder]);
+    dc.colors[i][ColFG]     = getcolor(colornames[i][ColFG]);
+    dc.colors[i][ColBG]     = getcolor(colornames[i][ColBG]);
+  }
+  profilephase("colors");
+
+  /* fontconfig was initialized in the background meanwhile */
+  initfont(font);
+  profilephase("font");
+
+  sw = DisplayWidth(dpy, screen);
+  sh = DisplayHeight(dpy, screen);
+  bh = dc.h = user_bh ? user_bh : dc.font.height + 2;
+
+  updategeom();
+  loadstate();
+  profilephase("geometry");
 
-  dc.drawable        = XCreatePixmap(dpy,
-                                     root,
-                                     DisplayWidth(dpy, screen),
-                                     bh,
-                                     DefaultDepth(dpy, screen)
-                                     );
   dc.gc              = XCreateGC(dpy, root, 0, NULL);
 
   XSetLineAttributes(dpy, dc.gc, 1, LineSolid, CapButt, JoinMiter);
@@ -3398,6 +6932,8 @@ setup(void)
   /* init bars */
   updatebars();
   updatestatus();
+  modsetup();
+  profilephase("bars");
 
   /* EWMH support per view */
   XChangeProperty(dpy,
@@ -3429,8 +6965,117 @@ setup(void)
                           &wa
                           );
   XSelectInput(dpy, root, wa.event_mask);
+  updatenumlockmask();
   grabkeys();
+
+#ifdef PWKL
+  /* track the keyboard group from events instead of asking for it */
+  {
+    int         major = XkbMajorVersion, minor = XkbMinorVersion;
+    XkbStateRec kbd_state;
+
+    if (XkbQueryExtension(dpy, NULL, &xkbevent, NULL, &major, &minor))
+    {
+      XkbSelectEventDetails(dpy,
+                            XkbUseCoreKbd,
+                            XkbStateNotify,
+                            XkbGroupStateMask,
+                            XkbGroupStateMask
+                            );
+      if (XkbGetState(dpy, XkbUseCoreKbd, &kbd_state) == Success)
+        kbdgrp = kbd_state.group;
+    }
+    else
+      xkbevent = -1;
+  }
+#endif /* PWKL */
+
+  profilephase("grabs");
+}
+
+#ifdef IPC
+static void
+setwatch(int fd, short events)
+{
+  int i;
+
+  for (i = 0;  i < nwatches;  i++)
+    if (pfds[i].fd == fd)
+      pfds[i].events = events;
+}
+#endif /* IPC */
+
+#ifdef HARFBUZZ
+/* Returns the glyphs of the len bytes of text shaped with font f,
+ * which all have glyphs in f.  Runs are cached by their text and font,
+ * an entry is only replaced by a run with the same hash. */
+static Shaped *
+shaperun(const char *text, int len, XftFont *f)
+{
+  hb_buffer_t          *buf;
+  hb_glyph_info_t      *info;
+  hb_glyph_position_t  *pos;
+  hb_position_t         x;
+  unsigned int          i, n, h = 2166136261u;
+  Shaped               *s;
+
+  for (n = 0;  n < dc.font.nxfonts  &&  dc.font.xfonts[n] != f;  n++)
+    /* NOTHING */;
+
+  /* FNV-1a of the font index and the text */
+  h = (h ^ n) * 16777619u;
+  for (i = 0;  i < (unsigned int)len;  i++)
+    h = (h ^ (unsigned char)text[i]) * 16777619u;
+
+  s = &shaped[h & (SHAPECACHE - 1)];
+  if (    s->text
+      &&  s->font == f
+      &&  s->len  == len
+      && !memcmp(s->text, text, len)
+      )
+    return s;
+
+  buf = hb_buffer_create();
+  hb_buffer_add_utf8(buf, text, len, 0, len);
+  hb_buffer_guess_segment_properties(buf);
+  hb_shape(dc.font.hbfonts[n], buf, NULL, 0);
+
+  info = hb_buffer_get_glyph_infos(buf, &n);
+  pos  = hb_buffer_get_glyph_positions(buf, NULL);
+
+  free(s->text);
+  free(s->specs);
+  free(s->clusters);
+  free(s->pen);
+
+  if (   !(s->text     = malloc(len + 1))
+      || !(s->specs    = malloc((n + 1) * sizeof(XftGlyphSpec)))
+      || !(s->clusters = malloc((n + 1) * sizeof(unsigned int)))
+      || !(s->pen      = malloc((n + 1) * sizeof(int)))
+      )
+    die("fatal: could not malloc() %u bytes\n", (n + 1) * sizeof(XftGlyphSpec));
+
+  memcpy(s->text, text, len);
+  s->len     = len;
+  s->font    = f;
+  s->nglyphs = n;
+
+  /* positions are in 26.6 fixed point */
+  for (i = 0, x = 0;  i < n;  x += pos[i++].x_advance)
+  {
+    s->specs[i].glyph = info[i].codepoint;
+    s->specs[i].x     = (x + pos[i].x_offset) / 64;
+    s->specs[i].y     = -pos[i].y_offset / 64;
+    s->clusters[i]    = info[i].cluster;
+    s->pen[i]         = x / 64;
+  }
+  s->pen[n] = x / 64;
+
+  hb_buffer_destroy(buf);
+
+  return s;
 }
+#endif /* HARFBUZZ */
 
 static void
 showhide(Client *c)
@@ -3460,44 +7105,181 @@ showhide(Client *c)
 }
 
 static void
-sigchld(__attribute__((unused)) int sig)
+sighandler(int sig)
 {
-  if (signal(SIGCHLD, sigchld) == SIG_ERR)
-    die("Can't install SIGCHLD handler");
+  int           olderrno = errno;
+  unsigned char c        = sig;
 
-  while (0 < waitpid(-1, NULL, WNOHANG))
-    /* NOTHING */;
+  /* a full pipe already wakes up the main loop */
+  if (write(sigpipe[1], &c, 1) < 0)
+  {
+    /* NOTHING */
+  }
+
+  errno = olderrno;
+}
+
+/* Shows a window of the warm pool of the command if one is ready,
+ * starts the command otherwise. */
+static void
+spawn(const Arg *arg)
+{
+  Client *c;
+  int     i;
+
+  if ((i = poolfind(arg->v)) >= 0  &&  (c = poolclient(i)))
+  {
+    /* shown like a new window, at the head of the list */
+    c->pool = 0;
+    detach(c);
+    attach(c);
+#ifdef IPC
+    ipcevent(EvMap, c->mon, "%#lx", c->win);
+#endif /* IPC */
+    updateclientlist();
+    summon(c);
+    poolfill();
+    return;
+  }
+
+  launch((char *const *)arg->v, -1);
+}
+
+/* Starts argv[0], searched in PATH, in a new session with the default
+ * signal dispositions and an empty signal mask.  Its stdout is outfd
+ * unless that is -1.  All descriptors of rawm are close-on-exec, so
+ * only stdin, stdout and stderr are inherited.  The child is reaped by
+ * readsignals(). */
+static pid_t
+spawnchild(char *const argv[], int outfd)
+{
+  extern char              **environ;
+  posix_spawn_file_actions_t fa;
+  pid_t                      pid;
+  int                        err;
+
+  if (outfd >= 0)
+  {
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_adddup2(&fa, outfd, STDOUT_FILENO);
+  }
+
+  err = posix_spawnp(&pid, argv[0], outfd >= 0 ? &fa : NULL,
+                     &spawnattr, argv, environ);
+
+  if (outfd >= 0)
+    posix_spawn_file_actions_destroy(&fa);
+
+  if (err)
+  {
+    fprintf(stderr, "rawm: cannot run %s: %s\n", argv[0],
+            strerror(err));
+    return -1;
+  }
+
+  return pid;
 }
 
 static void
-sighup(__attribute__((unused)) int sig)
+statuscleanup(void)
 {
-  Arg a = {.i = 1};
-  quit(&a);
+  unsigned int i;
+
+  if (statusfd >= 0)
+  {
+    delwatch(statusfd);
+    close(statusfd);
+    close(statuswfd);
+    unlink(statuspath);
+    statusfd = statuswfd = -1;
+  }
+
+  for (i = 0;  i < nblocks;  i++)
+  {
+    free(blocks[i].name);
+    free(blocks[i].text);
+    free(blocks[i].spans);
+  }
+  free(blocks);
+  blocks  = NULL;
+  nblocks = 0;
 }
 
+/* Creates the status FIFO and watches it.  rawm keeps it open for
+ * writing as well, so that writers may come and go without the FIFO
+ * reporting end of file.  An existing path is only used if it is a
+ * FIFO of the user, anything else is left alone. */
 static void
-sigterm(__attribute__((unused)) int sig)
+statussetup(void)
 {
-  Arg a = {.i = 0};
-  quit(&a);
+  struct stat  st;
+  const char  *err    = NULL;
+  const char  *notown = "not a FIFO owned by the user";
+
+  if (   !displaypath(statuspath, sizeof(statuspath), statusfifo,
+                      "RAWM_STATUS")
+      || !*statuspath)
+    return;
+
+  if (   (mkfifo(statuspath, 0600) < 0  &&  errno != EEXIST)
+      ||  lstat(statuspath, &st) < 0)
+    err = strerror(errno);
+  else if (!S_ISFIFO(st.st_mode)  ||  st.st_uid != getuid())
+    err = notown;
+  else if ((statusfd = open(statuspath,
+                            O_RDONLY | O_NONBLOCK | O_NOFOLLOW)) < 0)
+    err = strerror(errno);
+  /* the path may have been replaced since lstat() */
+  else if (   fstat(statusfd, &st) < 0
+           || !S_ISFIFO(st.st_mode)
+           ||  st.st_uid != getuid())
+    err = notown;
+  else if (   (statuswfd = open(statuspath,
+                                O_WRONLY | O_NONBLOCK | O_NOFOLLOW)) < 0
+           || !addwatch(statusfd, POLLIN, readstatus, NULL))
+    err = strerror(errno);
+
+  if (err)
+  {
+    fprintf(stderr, "rawm: cannot open status FIFO %s: %s\n",
+            statuspath, err);
+    if (statusfd >= 0)
+      close(statusfd);
+    if (statuswfd >= 0)
+      close(statuswfd);
+    statusfd = statuswfd = -1;
+    return;
+  }
+
+  fcntl(statusfd,  F_SETFD, FD_CLOEXEC);
+  fcntl(statuswfd, F_SETFD, FD_CLOEXEC);
+  setenv("RAWM_STATUS", statuspath, 1);
 }
 
+/* Moves c to the selected monitor and tags, centred if it floats, and
+ * focuses it. */
 static void
-spawn(const Arg *arg)
+summon(Client *c)
 {
-  if (fork() == 0)
+  if (c->mon != selmon)
   {
-    if (dpy)
-      close(ConnectionNumber(dpy));
+    detach(c);
+    detachstack(c);
+    c->mon = selmon;
+    attach(c);
+    attachstack(c);
+  }
 
-    setsid();
-    execvp(((char **)arg->v)[0],
-            (char **)arg->v);
-    fprintf(stderr, "rawm: execvp %s", ((char **)arg->v)[0]);
-    perror(" failed");
-    exit(EXIT_SUCCESS);
+  c->tags = selmon->tagset[selmon->seltags];
+
+  if (c->isfloating)
+  {
+    c->x = selmon->mx + (selmon->mw - WIDTH(c))  / 2;
+    c->y = selmon->my + (selmon->mh - HEIGHT(c)) / 2;
   }
+
+  focus(c);
+  arrange(selmon);
 }
 
 static void
@@ -3524,10 +7306,62 @@ tagmon(const Arg *arg)
 static int
 textnw(const char *text, unsigned int len)
 {
-  XGlyphInfo ext;
+  XftFont    *f;
+  int         n, w = 0;
+#ifdef HARFBUZZ
+  Shaped     *s;
+#else
+  XGlyphInfo  ext;
+#endif /* HARFBUZZ */
+
+  for ( ;  len > 0;  text += n, len -= n)
+  {
+    n  = fontrun(text, len, &f);
+#ifdef HARFBUZZ
+    s  = shaperun(text, n, f);
+    w += s->pen[s->nglyphs];
+#else
+    XftTextExtentsUtf8(dpy, f, (XftChar8 *)text, n, &ext);
+    w += ext.xOff;
+#endif /* HARFBUZZ */
+  }
+
+  return w;
+}
+
+/* Splits str in place into at most max words separated by blanks,
+ * words may be double quoted, a line whose first word starts with #
+ * is a comment. */
+static int
+tokenize(char *str, char *argv[], int max)
+{
+  int   argc = 0;
+  char *p    = str;
+
+  while (argc < max)
+  {
+    while (*p == ' '  ||  *p == '\t'  ||  *p == '\n'  ||  *p == '\r')
+      p++;
+
+    if (!*p  ||  (!argc  &&  *p == '#'))
+      break;
+
+    if (*p == '"')
+    {
+      argv[argc++] = ++p;
+      p += strcspn(p, "\"");
+    }
+    else
+    {
+      argv[argc++] = p;
+      p += strcspn(p, " \t\n\r");
+    }
+
+    if (*p)
+      *p++ = '\0';
+  }
 
-  XftTextExtentsUtf8(dpy, dc.font.xfont, (XftChar8 *)text, len, &ext);
-  return ext.xOff;
+  return argc;
 }
 
 static void
@@ -3591,23 +7425,7 @@ togglebar(__attribute__((unused)) const Arg *arg)
 
 #ifdef SYSTRAY
   resizebarwin(selmon);
-
-  if (showsystray)
-  {
-    XWindowChanges wc;
-
-    if (!selmon->showbar)
-      wc.y = -bh;
-    else if (selmon->showbar)
-    {
-      wc.y = 0;
-
-      if (!selmon->topbar)
-        wc.y = selmon->mh - bh;
-    }
-
-    XConfigureWindow(dpy, systray->win, CWY, &wc);
-  }
+  updatesystray();
 #else
   XMoveResizeWindow(dpy,
                     selmon->barwin,
@@ -3656,6 +7474,38 @@ togglefullscr(__attribute__((unused)) const Arg *arg)
     setfullscreen(selmon->sel, !selmon->sel->isfullscreen);
 }
 
+/* Hides the scratchpad if it is visible on the selected monitor,
+ * shows it there otherwise.  Its command is started on first use
+ * only, the window is kept hidden on no tag in between. */
+static void
+togglescratch(const Arg *arg)
+{
+  unsigned int  i = (const Scratchpad *)arg->v - scratchpads + 1, j;
+  Monitor      *m;
+  Client       *c = NULL;
+
+  for (m = mons;  m  &&  !c;  m = m->next)
+    for (c = m->clients;  c  &&  c->scratch != i;  c = c->next)
+      /* NOTHING */;
+
+  if (!c)
+  {
+    for (j = 0;  j < npending;  j++)
+      if (pending[j].scratch == i)
+        return;
+
+    pendingadd(scratchpads[i - 1].cmd, 0, i);
+  }
+  else if (c->mon == selmon  &&  ISVISIBLE(c))
+  {
+    c->tags = 0;
+    focus(NULL);
+    arrange(selmon);
+  }
+  else
+    summon(c);
+}
+
 static void
 toggletag(const Arg *arg)
 {
@@ -3721,10 +7571,6 @@ unfocus(Client *c, bool setfocus)
   if (!c)
     return;
 
-#ifdef PWKL
-  XkbStateRec kbd_state;
-#endif /* PWKL */
-
   grabbuttons(c, false);
   XSetWindowBorder(dpy, c->win, dc.colors[0][ColBorder].pixel);
 
@@ -3735,8 +7581,7 @@ unfocus(Client *c, bool setfocus)
   }
 
 #ifdef PWKL
-  XkbGetState(dpy, XkbUseCoreKbd, &kbd_state);
-  c->kbdgrp = kbd_state.group;
+  c->kbdgrp = kbdgrp;
 #endif /* PWKL */
 }
 
@@ -3745,24 +7590,28 @@ unmanage(Client *c, bool destroyed)
 {
   Monitor        *m = c->mon;
   XWindowChanges  wc;
+  unsigned long   seq;
 
-  /* The server grab construct avoids race conditions. */
   detach(c);
   detachstack(c);
+#ifdef IPC
+  if (!c->pool)
+    ipcevent(EvUnmap, m, "%#lx", c->win);
+#endif /* IPC */
+  if (c->pool  &&  running  &&  !pooltimer)
+    pooltimer = addtimer(POOLDELAY, 0, poolrefill, NULL);
   if (!destroyed)
   {
+    /* the window may be destroyed meanwhile, ignore errors */
     wc.border_width = c->oldbw;
-    XGrabServer(dpy);
-    XSetErrorHandler(xerrordummy);
+    seq = ignorebegin();
 
     /* restore border */
     XConfigureWindow(dpy, c->win, CWBorderWidth, &wc);
 
     XUngrabButton(dpy, AnyButton, AnyModifier, c->win);
     setclientstate(c, WithdrawnState);
-    XSync(dpy, false);
-    XSetErrorHandler(xerror);
-    XUngrabServer(dpy);
+    ignoreend(seq);
   }
   free(c);
   focus(NULL);
@@ -3787,7 +7636,6 @@ unmapnotify(XEvent *e)
   else if ((c = wintosystrayicon(ev->window)))
   {
     removesystrayicon(c);
-    resizebarwin(selmon);
     updatesystray();
   }
 #endif /* SYSTRAY */
@@ -3835,7 +7683,7 @@ updatebars(void)
     {
       XChangeProperty(dpy,
                       m->barwin,
-                      XInternAtom(dpy, "_NET_WM_WINDOW_OPACITY", false),
+                      netatom[NetWMWindowOpacity],
                       XA_CARDINAL,
                       32,
                       PropModeReplace,
@@ -3872,6 +7720,9 @@ updateclientlist()
   {
     for (c = m->clients;  c;  c = c->next)
     {
+      if (c->pool)
+        continue;
+
       XChangeProperty(dpy,
                       root,
                       netatom[NetClientList],
@@ -3885,6 +7736,53 @@ updateclientlist()
   }
 }
 
+static void
+updateltsymbol(Monitor *m)
+{
+  Client *c;
+
+  /* tiled layout: []= X
+   * where X is the number of clients in master area */
+  if (m->lt[m->sellt]->arrange == tile)
+    snprintf(m->ltsymbol, sizeof m->ltsymbol, "[]= %d", m->nmaster);
+
+  /* float/monocle layout: [X/Y] or <X/Y>
+   * where X is the current window number, and Y is the number of
+   * clients in master area */
+  else if (  (   m->lt[m->sellt]->arrange == monocle
+              || m->lt[m->sellt]->arrange == NULL )
+           && m == selmon /* update only on selected monitor */
+           )
+  {
+    unsigned int i = 0, j = 0;
+
+    for (c = selmon->clients;  c;  c = c->next)
+    {
+      if (ISVISIBLE(c))
+      {
+        i++;
+        if (c->win == selmon->sel->win)
+          j = i;
+      }
+    }
+
+    if (m->lt[m->sellt]->arrange == NULL)
+      snprintf(m->ltsymbol, sizeof m->ltsymbol, "<%u/%u>", j, i);
+    else
+      snprintf(m->ltsymbol, sizeof m->ltsymbol, "[%u/%u]", j, i);
+  }
+
+  else if (m->lt[m->sellt]->arrange == bstack)
+    snprintf(m->ltsymbol, sizeof m->ltsymbol, "TTT %d", m->nmaster);
+
+  else if (m->lt[m->sellt]->arrange == bstackhoriz)
+    snprintf(m->ltsymbol, sizeof m->ltsymbol, "=== %d", m->nmaster);
+
+  else if (m->lt[m->sellt]->arrange == gaplessgrid)
+    snprintf(m->ltsymbol, sizeof m->ltsymbol, "###");
+
+}
+
 static bool
 updategeom(void)
 {
@@ -4025,6 +7923,29 @@ updatenumlockmask(void)
   XFreeModifiermap(modmap);
 }
 
+static void
+updateprotocols(Client *c)
+{
+  int   n;
+  Atom *protocols;
+
+  c->protocols = 0;
+
+  if (!XGetWMProtocols(dpy, c->win, &protocols, &n))
+    return;
+
+  while (n--)
+  {
+    for (int i = 0;  i < WMLast;  i++)
+    {
+      if (protocols[n] == wmatom[i])
+        c->protocols |= 1 << i;
+    }
+  }
+
+  XFree(protocols);
+}
+
 static void
 updatesizehints(Client *c)
 {
@@ -4100,9 +8021,13 @@ updatesizehints(Client *c)
 void
 updatesystrayicongeom(Client *i, int w, int h)
 {
+  int ow, oh;
+
   if (!i)
     return;
 
+  ow   = i->w;
+  oh   = i->h;
   i->h = bh;
 
   if      (w == h)
@@ -4124,6 +8049,10 @@ updatesystrayicongeom(Client *i, int w, int h)
 
     i->h = bh;
   }
+
+  /* a new width moves all following icons, too */
+  if (i->w != ow  ||  i->h != oh)
+    setsystraydirty(i);
 }
 
 void
@@ -4172,6 +8101,7 @@ updatesystray(void)
 {
   XSetWindowAttributes wa;
   Client *i;
+  Monitor *m;
   unsigned int x = selmon->mx + selmon->mw;
   unsigned int w = 1;
 
@@ -4199,7 +8129,7 @@ updatesystray(void)
     {
       XChangeProperty(dpy,
                       systray->win,
-                      XInternAtom(dpy, "_NET_WM_WINDOW_OPACITY", False),
+                      netatom[NetWMWindowOpacity],
                       XA_CARDINAL,
                       32,
                       PropModeReplace,
@@ -4253,7 +8183,6 @@ updatesystray(void)
                 0,
                 0
                 );
-      XSync(dpy, False);
     }
     else
     {
@@ -4266,22 +8195,44 @@ updatesystray(void)
 
   for (w = 0, i = systray->icons; i; i = i->next)
   {
-    XMapRaised(dpy, i->win);
     w += systrayspacing;
-    XMoveResizeWindow(dpy, i->win, (i->x = w), 0, i->w, i->h);
+    if (i->isdirty)
+    {
+      XMoveResizeWindow(dpy, i->win, (i->x = w), 0, i->w, i->h);
+      i->isdirty = false;
+    }
     w += i->w;
-    if (i->mon != selmon)
-      i->mon = selmon;
+    i->mon = selmon;
   }
 
   w = w ? w + systrayspacing : 1;
   x -= w;
-  XMoveResizeWindow(dpy, systray->win, x, selmon->by, w, bh);
 
-  /* redraw background */
-  XSetForeground(dpy, dc.gc, dc.colors[0][ColBG].pixel);
-  XFillRectangle(dpy, systray->win, dc.gc, 0, 0, w, bh);
-  XSync(dpy, False);
+  if (   systray->mon != selmon
+      || systray->x   != (int)x
+      || systray->y   != selmon->by
+      || systray->w   != w
+      )
+  {
+    m = systray->mon;
+
+    systray->mon = selmon;
+    systray->x   = x;
+    systray->y   = selmon->by;
+    systray->w   = w;
+    XMoveResizeWindow(dpy, systray->win, x, selmon->by, w, bh);
+
+    /* redraw background */
+    XSetForeground(dpy, dc.gc, dc.colors[0][ColBG].pixel);
+    XFillRectangle(dpy, systray->win, dc.gc, 0, 0, w, bh);
+
+    /* make room on the bar the systray moved to, and give it back
+     * on the one it left */
+    if (m  &&  m != selmon  &&  m->barwin)
+      resizebarwin(m);
+    if (selmon->barwin)
+      resizebarwin(selmon);
+  }
 }
 #endif /* SYSTRAY */
 
@@ -4295,25 +8246,29 @@ updatetitle(Client *c)
     strcpy(c->name, broken);
 }
 
+/* Sets the root block from WM_NAME of the root window.  Without it
+ * and without other blocks, the version is shown. */
 static void
 updatestatus(void)
 {
-  if (!gettextprop(root, XA_WM_NAME, stext, sizeof(stext)))
-    strcpy(stext, "rawm "VERSION);
+  char *text;
 
-  drawbar(selmon);
+  if ((text = gettextdup(root, XA_WM_NAME)))
+  {
+    setblock("root", text);
+    free(text);
+  }
+  else
+    setblock("root", nblocks > 1 ? "" : "rawm "VERSION);
 }
 
 static void
 updatewindowtype(Client *c)
 {
-  Atom state = getatomprop(c, netatom[NetWMState]);
-  Atom wtype = getatomprop(c, netatom[NetWMWindowType]);
-
-  if (state == netatom[NetWMFullscreen])
+  if (c->winstate == netatom[NetWMFullscreen])
     setfullscreen(c, true);
 
-  if (wtype == netatom[NetWMWindowTypeDialog])
+  if (c->wintype == netatom[NetWMWindowTypeDialog])
   {
     c->iscentered = autocenter_NetWMWindowTypeDialog;
     c->isfloating = true;
@@ -4325,21 +8280,28 @@ updatewmhints(Client *c)
 {
   XWMHints *wmh;
 
-  if ((wmh = XGetWMHints(dpy, c->win)))
-  {
-    if (   c == selmon->sel
-        && wmh->flags & XUrgencyHint
-        )
-    {
-      wmh->flags &= ~XUrgencyHint;
-      XSetWMHints(dpy, c->win, wmh);
-    }
-    else
-      c->isurgent = (wmh->flags & XUrgencyHint) ? true : false;
+  if (!(c->haswmh = (wmh = XGetWMHints(dpy, c->win)) != NULL))
+    return;
 
-    c->neverfocus = (wmh->flags & InputHint) ? (!wmh->input) : false;
-    XFree(wmh);
+  if (   c == selmon->sel
+      && wmh->flags & XUrgencyHint
+      )
+  {
+    wmh->flags &= ~XUrgencyHint;
+    XSetWMHints(dpy, c->win, wmh);
   }
+  else if (c->isurgent != !!(wmh->flags & XUrgencyHint))
+  {
+    c->isurgent = !c->isurgent;
+#ifdef IPC
+    if (!c->pool)
+      ipcevent(EvUrgent, c->mon, "%#lx %d", c->win, c->isurgent);
+#endif /* IPC */
+  }
+
+  c->neverfocus = (wmh->flags & InputHint) ? (!wmh->input) : false;
+  c->wmh        = *wmh;
+  XFree(wmh);
 }
 
 static void
@@ -4435,7 +8397,7 @@ wintosystrayicon(Window w)
 {
   Client *i = NULL;
 
-  if (!showsystray || !w)
+  if (!showsystray || !systray || !w)
     return i;
 
   for (i = systray->icons;
@@ -4480,6 +8442,14 @@ winview(__attribute__((unused)) const Arg* arg)
 static int
 xerror(Display *dpy, XErrorEvent *ee)
 {
+  for (int i = 0;  i < MAXIGNORED;  i++)
+  {
+    if (   ee->serial >= ignored[i].first
+        && ee->serial <= ignored[i].last
+        )
+      return 0;
+  }
+
   if (       ee->error_code   == BadWindow
       || (   ee->request_code == X_SetInputFocus
           && ee->error_code   == BadMatch)
@@ -4509,13 +8479,6 @@ xerror(Display *dpy, XErrorEvent *ee)
   return xerrorxlib(dpy, ee); /* may call exit */
 }
 
-static int
-xerrordummy(__attribute__((unused)) Display     *dpy,
-            __attribute__((unused)) XErrorEvent *ee )
-{
-  return 0;
-}
-
 /* Startup Error handler to check if another window manager is already
  * running. */
 static int
@@ -4526,6 +8489,19 @@ xerrorstart(__attribute__((unused)) Display     *dpy,
   return -1;
 }
 
+#ifdef PWKL
+static void
+xkbstatenotify(XEvent *e)
+{
+  XkbEvent *ev = (XkbEvent *)e;
+
+  if (   ev->any.xkb_type == XkbStateNotify
+      && ev->state.changed & XkbGroupStateMask
+      )
+    kbdgrp = ev->state.group;
+}
+#endif /* PWKL */
+
 static void
 zoom(__attribute__((unused)) const Arg *arg)
 {
@@ -4549,23 +8525,51 @@ zoom(__attribute__((unused)) const Arg *arg)
 int
 main(int argc, char *argv[])
 {
+#ifdef IPC
+  if (argc >= 3  &&  !strcmp("-c", argv[1]))
+    return ipcsend(argc - 2, argv + 2);
+#endif /* IPC */
+
   if (argc == 2  &&  !strcmp("-v", argv[1]))
     die("rawm "VERSION"\n");
+  else if (argc == 2  &&  !strcmp("-t", argv[1]))
+    profile = true;
   else if (argc != 1)
-    die("usage: rawm [-v]\n");
+#ifdef IPC
+    die("usage: rawm [-v] [-t] [-c command [argument ...]]\n");
+#else
+    die("usage: rawm [-v] [-t]\n");
+#endif /* IPC */
+
+  profilephase(NULL);
+
+  initspawn();
+#ifdef LAUNCHER
+  launcherstart();
+#endif /* LAUNCHER */
 
   if (!setlocale(LC_CTYPE, "")  ||  !XSupportsLocale())
     fputs("warning: no locale support\n", stderr);
 
+  /* fontconfig does not depend on the display, but reads the locale
+   * set above */
+  fontthreadrunning = !pthread_create(&fontthread, NULL, fontinit, NULL);
+
   if (!(dpy = XOpenDisplay(NULL)))
     die("rawm: cannot open display\n");
+  profilephase("display");
 
   checkotherwm();
+  profilephase("checkotherwm");
   setup();
   scan();
+  profilephase("scan");
   run();
   if (restart)
+  {
+    savestate();
     execvp(argv[0], argv);
+  }
   cleanup();
   XCloseDisplay(dpy);
 